@@ -0,0 +1,442 @@
+/* ************************************************************************
+> File Name:     block_skiplist.h
+> Description:   整数key的宽节点跳表: 第0层的节点是一块有序的key数组(最多BLOCK_KEYS个)，
+>                块内查找用AVX2/SSE一次比较多个key，没有SIMD时用标量比较。
+>                节点数约为key数的1/16~1/32，查找时跟随的指针和缓存缺失都少得多
+ ************************************************************************/
+
+#ifndef BLOCK_SKIPLIST_H
+#define BLOCK_SKIPLIST_H
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#if defined(BLOCK_SKIPLIST_NO_SIMD)    // 编译时定义此宏则块内查找只用标量比较，用于对比
+#undef BLOCK_SKIPLIST_AVX2
+#elif defined(__AVX2__)
+#define BLOCK_SKIPLIST_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#define BLOCK_SKIPLIST_SSE
+#include <immintrin.h>
+#endif
+#include "random_level.h"
+
+#define BLOCK_KEYS 32       // 每块最多的key数，必须是8的倍数
+#define BLOCK_MERGE_AT 8    // 删除后块内key数少于它时尝试与后一块合并
+
+// 有序块内小于key的元素个数
+// 块内没用到的位置填充K的最大值，总是比较整块，不需要按元素个数分支。
+// 32/64位有符号整数用SIMD比较，每次比较的结果压成位掩码后数1的个数。
+template<typename K>
+inline int block_rank(const K* keys, K key) {
+#if defined(BLOCK_SKIPLIST_AVX2)
+    if constexpr (std::is_signed<K>::value && sizeof(K) == 4) {
+        __m256i k = _mm256_set1_epi32(static_cast<int32_t>(key));
+        int n = 0;
+        for (int i = 0; i < BLOCK_KEYS; i += 8) {
+            __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(keys + i));
+            n += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, v))));
+        }
+        return n;
+    } else if constexpr (std::is_signed<K>::value && sizeof(K) == 8) {
+        __m256i k = _mm256_set1_epi64x(static_cast<int64_t>(key));
+        int n = 0;
+        for (int i = 0; i < BLOCK_KEYS; i += 4) {
+            __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(keys + i));
+            n += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k, v))));
+        }
+        return n;
+    }
+#elif defined(BLOCK_SKIPLIST_SSE)
+    if constexpr (std::is_signed<K>::value && sizeof(K) == 4) {
+        __m128i k = _mm_set1_epi32(static_cast<int32_t>(key));
+        int n = 0;
+        for (int i = 0; i < BLOCK_KEYS; i += 4) {
+            __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(keys + i));
+            n += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(k, v))));
+        }
+        return n;
+    }
+#if defined(__SSE4_2__)
+    else if constexpr (std::is_signed<K>::value && sizeof(K) == 8) {
+        __m128i k = _mm_set1_epi64x(static_cast<int64_t>(key));
+        int n = 0;
+        for (int i = 0; i < BLOCK_KEYS; i += 2) {
+            __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(keys + i));
+            n += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(k, v))));
+        }
+        return n;
+    }
+#endif
+#endif
+    int n = 0;
+    for (int i = 0; i < BLOCK_KEYS; i++) {
+        n += keys[i] < key ? 1 : 0;//编译为无分支的比较累加
+    }
+    return n;
+}
+
+// 跳表的一个块
+// 块按keys[0]参与上层的索引；forward数组紧跟在块后面，与块在同一块内存中。
+template<typename K, typename V>
+struct KeyBlock {
+    static KeyBlock<K, V>* create(int level);
+    static void destroy(KeyBlock<K, V> *block);
+
+    // 块内第一个不小于key的位置
+    int rank(K key) const { return block_rank(keys, key); }
+
+    alignas(32) K keys[BLOCK_KEYS];//有序，[count, BLOCK_KEYS)填充K的最大值
+    int count;
+    int node_level;
+    KeyBlock<K, V> **forward;
+    V values[BLOCK_KEYS];
+};
+
+template<typename K, typename V>
+KeyBlock<K, V>* KeyBlock<K, V>::create(int level) {
+    size_t bytes = sizeof(KeyBlock<K, V>) + sizeof(KeyBlock<K, V>*) * (level + 1);
+    void *mem = ::operator new(bytes, std::align_val_t(alignof(KeyBlock<K, V>)));
+    KeyBlock<K, V> *block = new (mem) KeyBlock<K, V>();
+    for (int i = 0; i < BLOCK_KEYS; i++) {
+        block->keys[i] = std::numeric_limits<K>::max();
+    }
+    block->count = 0;
+    block->node_level = level;
+    block->forward = reinterpret_cast<KeyBlock<K, V>**>(block + 1);
+    memset(block->forward, 0, sizeof(KeyBlock<K, V>*) * (level + 1));
+    return block;
+}
+
+template<typename K, typename V>
+void KeyBlock<K, V>::destroy(KeyBlock<K, V> *block) {
+    block->~KeyBlock<K, V>();
+    ::operator delete(block, std::align_val_t(alignof(KeyBlock<K, V>)));
+}
+
+// 宽节点跳表，接口与SkipList保持一致，key限定为整数类型
+// 第i层(i>0)按块的第一个key索引块，从上往下找到第一个key不大于目标的块，再在块内查找。
+// 插入时块满则对半分裂，新块以随机层数链接在原块之后；
+// 删除后块空了就摘除，块太空时与后一块合并。
+// 所有操作在一把锁内完成。
+template <typename K, typename V>
+class BlockSkipList {
+    static_assert(std::is_integral<K>::value, "BlockSkipList requires an integer key type");
+
+public:
+    BlockSkipList(int);
+    ~BlockSkipList();
+    int insert_element(K, V);
+    void display_list();
+    bool search_element(K);
+    bool search_element(K, V*);
+    std::optional<V> find(K);
+    void delete_element(K);
+    size_t size();
+
+    // 块数，以及所有块和块内数组占用的字节数
+    size_t block_count();
+    size_t memory_usage();
+
+private:
+    typedef KeyBlock<K, V> Block;
+
+    BlockSkipList(const BlockSkipList &);
+    BlockSkipList &operator=(const BlockSkipList &);
+
+    // 以下都在锁内调用
+    // 最后一个第一个key不大于key的块，找不到返回NULL；update记录每层的前驱
+    Block* find_block(K key, Block **update);
+    // 每层最后一个第一个key小于key的块
+    void find_before(K key, Block **update);
+    void link_block(Block *block, Block **update);
+    void unlink_block(Block *block);
+    Block* split_block(Block *block, Block **update);
+
+private:
+    // 该跳表最大层数
+    int _max_level;
+
+    // 该跳表当前层数
+    int _skip_list_level;
+
+    // 头节点，不存放key
+    Block *_header;
+
+    // 元素数和块数
+    size_t _element_count;
+    size_t _block_count;
+
+    std::mutex _mtx;
+
+    // 新块的层数
+    LevelGenerator _level_gen;
+};
+
+template<typename K, typename V>
+BlockSkipList<K, V>::BlockSkipList(int max_level)
+    : _max_level(max_level), _skip_list_level(0), _element_count(0), _block_count(0), _level_gen(max_level) {
+    _header = Block::create(_max_level);
+}
+
+template<typename K, typename V>
+BlockSkipList<K, V>::~BlockSkipList() {
+    Block *block = _header->forward[0];
+    while (block != NULL) {
+        Block *next = block->forward[0];
+        Block::destroy(block);
+        block = next;
+    }
+    Block::destroy(_header);
+}
+
+template<typename K, typename V>
+typename BlockSkipList<K, V>::Block* BlockSkipList<K, V>::find_block(K key, Block **update) {
+    Block *current = _header;
+    for (int i = _skip_list_level; i >= 0; i--) {
+        while (current->forward[i] != NULL && current->forward[i]->keys[0] <= key) {
+            current = current->forward[i];
+        }
+        if (update != NULL) {
+            update[i] = current;
+        }
+    }
+    return current == _header ? NULL : current;
+}
+
+template<typename K, typename V>
+void BlockSkipList<K, V>::find_before(K key, Block **update) {
+    Block *current = _header;
+    for (int i = _skip_list_level; i >= 0; i--) {
+        while (current->forward[i] != NULL && current->forward[i]->keys[0] < key) {
+            current = current->forward[i];
+        }
+        update[i] = current;
+    }
+}
+
+// 把block链接在update[i]之后
+template<typename K, typename V>
+void BlockSkipList<K, V>::link_block(Block *block, Block **update) {
+    int level = block->node_level;
+    if (level > _skip_list_level) {
+        for (int i = _skip_list_level + 1; i <= level; i++) {
+            update[i] = _header;
+        }
+        _skip_list_level = level;
+    }
+    for (int i = 0; i <= level; i++) {
+        block->forward[i] = update[i]->forward[i];
+        update[i]->forward[i] = block;
+    }
+    _block_count++;
+}
+
+// 摘除并释放块，按块当前的keys[0]找前驱(各块的keys[0]互不相同且保持有序)
+template<typename K, typename V>
+void BlockSkipList<K, V>::unlink_block(Block *block) {
+    Block *update[_max_level + 1];
+    find_before(block->keys[0], update);
+    for (int i = 0; i <= block->node_level; i++) {
+        update[i]->forward[i] = block->forward[i];
+    }
+    while (_skip_list_level > 0 && _header->forward[_skip_list_level] == NULL) {
+        _skip_list_level--;
+    }
+    Block::destroy(block);
+    _block_count--;
+}
+
+// 满块对半分裂，后一半移到新块，返回新块
+// 新块的第一个key大于block中剩下的key，小于block原来后继的第一个key，所以在block链接到的层上
+// 链接在block之后，更高层上链接在查找路径update[i]之后
+template<typename K, typename V>
+typename BlockSkipList<K, V>::Block* BlockSkipList<K, V>::split_block(Block *block, Block **update) {
+    Block *right = Block::create(_level_gen.next());
+    int half = BLOCK_KEYS / 2;
+    for (int i = half; i < BLOCK_KEYS; i++) {
+        right->keys[i - half] = block->keys[i];
+        right->values[i - half] = std::move(block->values[i]);
+        block->keys[i] = std::numeric_limits<K>::max();
+    }
+    right->count = BLOCK_KEYS - half;
+    block->count = half;
+    // key比所有key都小时update全是头节点，block链接到的各层要改成从block之后链接
+    for (int i = 0; i <= block->node_level; i++) {
+        update[i] = block;
+    }
+    link_block(right, update);
+    return right;
+}
+
+// 插入元素，返回值与SkipList::insert_element相同: 1代表key已存在(更新value)，0代表插入了新key
+template<typename K, typename V>
+int BlockSkipList<K, V>::insert_element(K key, V value) {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    Block *update[_max_level + 1];
+    Block *block = find_block(key, update);
+    if (block == NULL) {
+        // 比所有key都小，放进第一块；表为空时新建一块
+        block = _header->forward[0];
+        if (block == NULL) {
+            block = Block::create(_level_gen.next());
+            link_block(block, update);
+        }
+    }
+
+    int pos = block->rank(key);
+    if (pos < block->count && block->keys[pos] == key) {
+        block->values[pos] = std::move(value);
+        return 1;
+    }
+
+    if (block->count == BLOCK_KEYS) {
+        Block *right = split_block(block, update);
+        if (pos > block->count) {
+            block = right;
+            pos -= BLOCK_KEYS / 2;
+        }
+    }
+
+    // 后面的元素右移一位
+    for (int i = block->count; i > pos; i--) {
+        block->keys[i] = block->keys[i - 1];
+        block->values[i] = std::move(block->values[i - 1]);
+    }
+    block->keys[pos] = key;
+    block->values[pos] = std::move(value);
+    block->count++;
+    _element_count++;
+    return 0;
+}
+
+template<typename K, typename V>
+bool BlockSkipList<K, V>::search_element(K key) {
+    return search_element(key, NULL);
+}
+
+template<typename K, typename V>
+bool BlockSkipList<K, V>::search_element(K key, V* value) {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    Block *block = find_block(key, NULL);
+    if (block == NULL) {
+        return false;
+    }
+    int pos = block->rank(key);
+    if (pos < block->count && block->keys[pos] == key) {
+        if (value != NULL) {
+            *value = block->values[pos];
+        }
+        return true;
+    }
+    return false;
+}
+
+template<typename K, typename V>
+std::optional<V> BlockSkipList<K, V>::find(K key) {
+    V value;
+    if (search_element(key, &value)) {
+        return std::optional<V>(std::move(value));
+    }
+    return std::nullopt;
+}
+
+// 删除元素
+// 块空了就摘除；块内key太少且能放进一块时，把后一块的key并过来并摘除后一块
+template<typename K, typename V>
+void BlockSkipList<K, V>::delete_element(K key) {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    Block *block = find_block(key, NULL);
+    if (block == NULL) {
+        return;
+    }
+    int pos = block->rank(key);
+    if (pos >= block->count || block->keys[pos] != key) {
+        return;
+    }
+    if (block->count == 1) {
+        unlink_block(block);//keys[0]还是key，按它找前驱
+        _element_count--;
+        return;
+    }
+
+    for (int i = pos; i < block->count - 1; i++) {
+        block->keys[i] = block->keys[i + 1];
+        block->values[i] = std::move(block->values[i + 1]);
+    }
+    block->count--;
+    block->keys[block->count] = std::numeric_limits<K>::max();
+    block->values[block->count] = V();
+    _element_count--;
+
+    // 删除第一个key后keys[0]变大，但仍小于后一块的keys[0]，上层索引的顺序不变
+    Block *next = block->forward[0];
+    if (block->count < BLOCK_MERGE_AT && next != NULL &&
+        block->count + next->count <= BLOCK_KEYS / 2) {
+        for (int i = 0; i < next->count; i++) {
+            block->keys[block->count + i] = next->keys[i];
+            block->values[block->count + i] = std::move(next->values[i]);
+        }
+        block->count += next->count;
+        unlink_block(next);
+    }
+}
+
+template<typename K, typename V>
+size_t BlockSkipList<K, V>::size() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _element_count;
+}
+
+template<typename K, typename V>
+size_t BlockSkipList<K, V>::block_count() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _block_count;
+}
+
+template<typename K, typename V>
+size_t BlockSkipList<K, V>::memory_usage() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    size_t bytes = 0;
+    for (Block *block = _header->forward[0]; block != NULL; block = block->forward[0]) {
+        bytes += sizeof(Block) + sizeof(Block*) * (block->node_level + 1);
+    }
+    return bytes;
+}
+
+// 打印跳表: 每层打印各块的第一个key，第0层打印所有数据
+template<typename K, typename V>
+void BlockSkipList<K, V>::display_list() {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    std::cout << "\n*****Block Skip List*****"<<"\n";
+    for (int i = _skip_list_level; i >= 1; i--) {
+        std::cout << "Level " << i << ": ";
+        for (Block *block = _header->forward[i]; block != NULL; block = block->forward[i]) {
+            std::cout << block->keys[0] << ";";
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "Level 0: ";
+    for (Block *block = _header->forward[0]; block != NULL; block = block->forward[0]) {
+        std::cout << "[";
+        for (int j = 0; j < block->count; j++) {
+            std::cout << block->keys[j] << ":" << block->values[j] << ";";
+        }
+        std::cout << "]";
+    }
+    std::cout << std::endl;
+}
+
+#endif
+// vim: et tw=100 ts=4 sw=4 cc=120
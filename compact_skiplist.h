@@ -0,0 +1,558 @@
+/* ************************************************************************
+> File Name:     compact_skiplist.h
+> Description:   省内存的字符串跳表: 第0层的节点是一块连续编码的有序记录，
+>                块内key做前缀压缩(只存与前一个key不同的后缀)，短value直接存在块内，
+>                长value单独分配。每个key的开销从一个节点(两个std::string、forward数组、分配器头)
+>                降到几个字节，适合key有公共前缀、value短而重复的数据
+ ************************************************************************/
+
+#ifndef COMPACT_SKIPLIST_H
+#define COMPACT_SKIPLIST_H
+
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "node_allocator.h"
+#include "random_level.h"
+#include "snapshot.h"
+
+#define COMPACT_BLOCK_BYTES 512     // 块的编码超过这个大小时对半分裂
+#define COMPACT_INLINE_VALUE 64     // 不超过这个长度的value存在块内
+
+// 块内一条记录的编码:
+//   varint 与前一个key相同的前缀长度 + varint 后缀长度 + varint value标记 + 后缀 + value
+// value标记为 长度<<1 | 是否在块外；块外的value存为8字节指针，指向单独分配的长度为"长度"的字节数组。
+// 每块第一条记录的前缀长度为0，即完整的key，上层索引直接用它比较。
+inline void compact_put_varint(std::string &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+inline uint64_t compact_get_varint(const char *&p) {
+    uint64_t v = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t b = static_cast<uint8_t>(*p++);
+        v |= static_cast<uint64_t>(b & 0x7F) << shift;
+        if (b < 0x80) {
+            return v;
+        }
+    }
+}
+
+// 解码出的一条记录，key是重建后的完整key，value指向块内或块外的数据
+struct CompactEntry {
+    std::string key;
+    const char *value;
+    uint32_t value_len;
+    bool external;
+
+    std::string_view value_view() const { return std::string_view(value, value_len); }
+};
+
+// 按顺序解码一块中的记录
+// key在_key中原地重建: 保留与前一个key相同的前缀，再接上后缀，不分配新的字符串
+class CompactCursor {
+public:
+    CompactCursor(const std::string &data) : _p(data.data()), _end(data.data() + data.size()) {}
+
+    bool next() {
+        if (_p == _end) {
+            return false;
+        }
+        size_t shared = compact_get_varint(_p);
+        size_t unshared = compact_get_varint(_p);
+        uint64_t tag = compact_get_varint(_p);
+        _key.resize(shared);
+        _key.append(_p, unshared);
+        _p += unshared;
+        _value_len = static_cast<uint32_t>(tag >> 1);
+        _external = (tag & 1) != 0;
+        if (_external) {
+            memcpy(&_value, _p, sizeof(_value));
+            _p += sizeof(_value);
+        } else {
+            _value = _p;
+            _p += _value_len;
+        }
+        return true;
+    }
+
+    const std::string &key() const { return _key; }
+    std::string_view value() const { return std::string_view(_value, _value_len); }
+    void fill(CompactEntry &entry) const {
+        entry.key = _key;
+        entry.value = _value;
+        entry.value_len = _value_len;
+        entry.external = _external;
+    }
+
+private:
+    const char *_p;
+    const char *_end;
+    std::string _key;
+    const char *_value;
+    uint32_t _value_len;
+    bool _external;
+};
+
+// 跳表的一个块，forward数组紧跟在块后面，与块在同一块内存中
+struct CompactBlock {
+    static CompactBlock* create(int level);
+    static void destroy(CompactBlock *block);
+
+    // 第一条记录的key，前缀长度为0所以可以直接从编码中取出
+    std::string_view first_key() const {
+        const char *p = data.data();
+        compact_get_varint(p);
+        size_t len = compact_get_varint(p);
+        compact_get_varint(p);
+        return std::string_view(p, len);
+    }
+
+    std::string data;//编码后的记录
+    uint32_t count;
+    int node_level;
+    CompactBlock **forward;
+};
+
+inline CompactBlock* CompactBlock::create(int level) {
+    void *mem = ::operator new(sizeof(CompactBlock) + sizeof(CompactBlock*) * (level + 1));
+    CompactBlock *block = new (mem) CompactBlock();
+    block->count = 0;
+    block->node_level = level;
+    block->forward = reinterpret_cast<CompactBlock**>(block + 1);
+    memset(block->forward, 0, sizeof(CompactBlock*) * (level + 1));
+    return block;
+}
+
+inline void CompactBlock::destroy(CompactBlock *block) {
+    block->~CompactBlock();
+    ::operator delete(block);
+}
+
+// 省内存的字符串跳表，接口与SkipList<std::string, std::string>保持一致
+// 结构同BlockSkipList: 上层按块的第一个key索引块，块满(编码超过COMPACT_BLOCK_BYTES)对半分裂，
+// 块空了摘除，块太小时与后一块合并。修改一块时把它解码成记录数组，改完整块重新编码。
+// 所有操作在一把锁内完成。
+class CompactSkipList {
+
+public:
+    CompactSkipList(int);
+    ~CompactSkipList();
+    int insert_element(const std::string&, const std::string&);
+    void display_list();
+    bool search_element(const std::string&);
+    bool search_element(const std::string&, std::string*);
+    std::optional<std::string> find(const std::string&);
+    void delete_element(const std::string&);
+    size_t size();
+
+    // 块、forward数组、块内编码和块外value实际占用的字节数(不含分配器自身的开销)
+    size_t memory_usage();
+    // 按key升序对每条记录调用fn(key, value)，fn在锁内执行
+    template<typename Fn>
+    void for_each(Fn fn);
+
+    // 二进制快照，格式与SkipList<std::string, std::string>的快照相同，两者可以互相加载
+    bool dump_snapshot(const std::string& path = SNAPSHOT_FILE, bool compress = false);
+    bool load_snapshot(const std::string& path = SNAPSHOT_FILE);
+
+private:
+    CompactSkipList(const CompactSkipList &);
+    CompactSkipList &operator=(const CompactSkipList &);
+
+    // 以下都在锁内调用
+    CompactBlock* find_block(const std::string &key, CompactBlock **update);
+    void find_before(std::string_view key, CompactBlock **update);
+    void link_block(CompactBlock *block, CompactBlock **update);
+    void unlink_block(CompactBlock *block);
+    // 块 <-> 记录数组
+    void decode(const CompactBlock *block, std::vector<CompactEntry> &entries);
+    // 块内value可能指向块原来的编码，所以编码到新的字符串，全部编码完再换进块里
+    static void encode(const std::vector<CompactEntry> &entries, size_t begin, size_t end, std::string &data);
+    static void set_data(CompactBlock *block, std::string &data, size_t count);
+    static void free_value(const CompactEntry &entry);
+
+private:
+    // 该跳表最大层数
+    int _max_level;
+
+    // 该跳表当前层数
+    int _skip_list_level;
+
+    // 头节点，不存放记录
+    CompactBlock *_header;
+
+    // 元素数
+    size_t _element_count;
+
+    std::mutex _mtx;
+
+    // 新块的层数
+    LevelGenerator _level_gen;
+
+    // 修改块时复用的记录数组
+    std::vector<CompactEntry> _entries;
+};
+
+inline CompactSkipList::CompactSkipList(int max_level)
+    : _max_level(max_level), _skip_list_level(0), _element_count(0), _level_gen(max_level) {
+    _header = CompactBlock::create(_max_level);
+}
+
+inline CompactSkipList::~CompactSkipList() {
+    CompactBlock *block = _header->forward[0];
+    while (block != NULL) {
+        CompactBlock *next = block->forward[0];
+        std::vector<CompactEntry> entries;
+        decode(block, entries);
+        for (size_t i = 0; i < entries.size(); i++) {
+            free_value(entries[i]);
+        }
+        CompactBlock::destroy(block);
+        block = next;
+    }
+    CompactBlock::destroy(_header);
+}
+
+inline void CompactSkipList::free_value(const CompactEntry &entry) {
+    if (entry.external) {
+        delete[] entry.value;
+    }
+}
+
+inline void CompactSkipList::decode(const CompactBlock *block, std::vector<CompactEntry> &entries) {
+    entries.resize(block->count);
+    CompactCursor cursor(block->data);
+    for (size_t i = 0; cursor.next(); i++) {
+        cursor.fill(entries[i]);
+    }
+}
+
+// 把entries[begin, end)编码到data
+inline void CompactSkipList::encode(const std::vector<CompactEntry> &entries, size_t begin, size_t end,
+                                    std::string &data) {
+    data.clear();
+    for (size_t i = begin; i < end; i++) {
+        const CompactEntry &e = entries[i];
+        size_t shared = 0;
+        if (i > begin) {
+            const std::string &prev = entries[i - 1].key;
+            size_t limit = std::min(prev.size(), e.key.size());
+            while (shared < limit && prev[shared] == e.key[shared]) {
+                shared++;
+            }
+        }
+        compact_put_varint(data, shared);
+        compact_put_varint(data, e.key.size() - shared);
+        compact_put_varint(data, (static_cast<uint64_t>(e.value_len) << 1) | (e.external ? 1 : 0));
+        data.append(e.key, shared, std::string::npos);
+        if (e.external) {
+            data.append(reinterpret_cast<const char*>(&e.value), sizeof(e.value));
+        } else {
+            data.append(e.value, e.value_len);
+        }
+    }
+}
+
+// 换上新的编码，块原来的编码换到data中，由调用者在用完指向它的记录后释放
+inline void CompactSkipList::set_data(CompactBlock *block, std::string &data, size_t count) {
+    data.shrink_to_fit();
+    block->data.swap(data);
+    block->count = static_cast<uint32_t>(count);
+}
+
+inline CompactBlock* CompactSkipList::find_block(const std::string &key, CompactBlock **update) {
+    CompactBlock *current = _header;
+    for (int i = _skip_list_level; i >= 0; i--) {
+        while (current->forward[i] != NULL && current->forward[i]->first_key() <= key) {
+            current = current->forward[i];
+        }
+        if (update != NULL) {
+            update[i] = current;
+        }
+    }
+    return current == _header ? NULL : current;
+}
+
+inline void CompactSkipList::find_before(std::string_view key, CompactBlock **update) {
+    CompactBlock *current = _header;
+    for (int i = _skip_list_level; i >= 0; i--) {
+        while (current->forward[i] != NULL && current->forward[i]->first_key() < key) {
+            current = current->forward[i];
+        }
+        update[i] = current;
+    }
+}
+
+inline void CompactSkipList::link_block(CompactBlock *block, CompactBlock **update) {
+    int level = block->node_level;
+    if (level > _skip_list_level) {
+        for (int i = _skip_list_level + 1; i <= level; i++) {
+            update[i] = _header;
+        }
+        _skip_list_level = level;
+    }
+    for (int i = 0; i <= level; i++) {
+        block->forward[i] = update[i]->forward[i];
+        update[i]->forward[i] = block;
+    }
+}
+
+// 摘除并释放块(块内记录的块外value已经转移或释放)，按块当前的第一个key找前驱
+inline void CompactSkipList::unlink_block(CompactBlock *block) {
+    CompactBlock *update[_max_level + 1];
+    find_before(block->first_key(), update);
+    for (int i = 0; i <= block->node_level; i++) {
+        update[i]->forward[i] = block->forward[i];
+    }
+    while (_skip_list_level > 0 && _header->forward[_skip_list_level] == NULL) {
+        _skip_list_level--;
+    }
+    CompactBlock::destroy(block);
+}
+
+// 插入元素，返回值与SkipList::insert_element相同: 1代表key已存在(更新value)，0代表插入了新key
+inline int CompactSkipList::insert_element(const std::string& key, const std::string& value) {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    CompactBlock *update[_max_level + 1];
+    CompactBlock *block = find_block(key, update);
+    if (block == NULL) {
+        // 比所有key都小，放进第一块；表为空时新建一块
+        block = _header->forward[0];
+        if (block == NULL) {
+            block = CompactBlock::create(_level_gen.next());
+            link_block(block, update);
+        }
+    }
+
+    decode(block, _entries);
+    size_t pos = 0;
+    while (pos < _entries.size() && _entries[pos].key < key) {
+        pos++;
+    }
+    int existed = pos < _entries.size() && _entries[pos].key == key ? 1 : 0;
+    CompactEntry old;
+    if (existed) {
+        old = _entries[pos];
+    } else {
+        _entries.insert(_entries.begin() + pos, CompactEntry());
+        _entries[pos].key = key;
+    }
+    CompactEntry &e = _entries[pos];
+    e.value_len = static_cast<uint32_t>(value.size());
+    e.external = value.size() > COMPACT_INLINE_VALUE;
+    if (e.external) {
+        char *copy = new char[value.size()];
+        memcpy(copy, value.data(), value.size());
+        e.value = copy;
+    } else {
+        e.value = value.data();
+    }
+
+    std::string data;
+    encode(_entries, 0, _entries.size(), data);
+    if (data.size() > COMPACT_BLOCK_BYTES && _entries.size() > 1) {
+        // 后一半移到新块，链接在block之后(block链接到的层上从block之后链接，更高层上从查找路径之后链接)
+        size_t half = _entries.size() / 2;
+        std::string right_data;
+        encode(_entries, half, _entries.size(), right_data);
+        encode(_entries, 0, half, data);
+        CompactBlock *right = CompactBlock::create(_level_gen.next());
+        set_data(right, right_data, _entries.size() - half);
+        set_data(block, data, half);
+        for (int i = 0; i <= block->node_level; i++) {
+            update[i] = block;
+        }
+        link_block(right, update);
+    } else {
+        set_data(block, data, _entries.size());
+    }
+    if (existed) {
+        free_value(old);
+    }
+    if (!existed) {
+        _element_count++;
+    }
+    return existed;
+}
+
+inline bool CompactSkipList::search_element(const std::string& key) {
+    return search_element(key, NULL);
+}
+
+inline bool CompactSkipList::search_element(const std::string& key, std::string* value) {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    CompactBlock *block = find_block(key, NULL);
+    if (block == NULL) {
+        return false;
+    }
+    CompactCursor cursor(block->data);
+    while (cursor.next()) {
+        int c = cursor.key().compare(key);
+        if (c == 0) {
+            if (value != NULL) {
+                value->assign(cursor.value().data(), cursor.value().size());
+            }
+            return true;
+        }
+        if (c > 0) {
+            break;
+        }
+    }
+    return false;
+}
+
+inline std::optional<std::string> CompactSkipList::find(const std::string& key) {
+    std::string value;
+    if (search_element(key, &value)) {
+        return std::optional<std::string>(std::move(value));
+    }
+    return std::nullopt;
+}
+
+// 删除元素
+// 块空了就摘除；块的编码小于COMPACT_BLOCK_BYTES的1/4且与后一块合起来不超过一半时，把后一块并过来
+inline void CompactSkipList::delete_element(const std::string& key) {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    CompactBlock *block = find_block(key, NULL);
+    if (block == NULL) {
+        return;
+    }
+    decode(block, _entries);
+    size_t pos = 0;
+    while (pos < _entries.size() && _entries[pos].key < key) {
+        pos++;
+    }
+    if (pos == _entries.size() || _entries[pos].key != key) {
+        return;
+    }
+    CompactEntry old = _entries[pos];
+    _element_count--;
+    if (_entries.size() == 1) {
+        unlink_block(block);//第一个key还是key，按它找前驱
+        free_value(old);
+        return;
+    }
+    _entries.erase(_entries.begin() + pos);
+
+    // 删除第一个key后块的第一个key变大，但仍小于后一块的第一个key，上层索引的顺序不变
+    CompactBlock *next = block->forward[0];
+    if (next != NULL && block->data.size() < COMPACT_BLOCK_BYTES / 4 &&
+        block->data.size() + next->data.size() <= COMPACT_BLOCK_BYTES / 2) {
+        std::vector<CompactEntry> tail;
+        decode(next, tail);
+        _entries.insert(_entries.end(), tail.begin(), tail.end());
+        std::string data;
+        encode(_entries, 0, _entries.size(), data);
+        set_data(block, data, _entries.size());
+        unlink_block(next);//块外value已经转移到block
+    } else {
+        std::string data;
+        encode(_entries, 0, _entries.size(), data);
+        set_data(block, data, _entries.size());
+    }
+    free_value(old);
+}
+
+inline size_t CompactSkipList::size() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _element_count;
+}
+
+inline size_t CompactSkipList::memory_usage() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    size_t bytes = 0;
+    for (CompactBlock *block = _header->forward[0]; block != NULL; block = block->forward[0]) {
+        bytes += sizeof(CompactBlock) + sizeof(CompactBlock*) * (block->node_level + 1);
+        bytes += HeapBytes<std::string>::of(block->data);
+        decode(block, _entries);
+        for (size_t i = 0; i < _entries.size(); i++) {
+            bytes += _entries[i].external ? _entries[i].value_len : 0;
+        }
+    }
+    return bytes;
+}
+
+template<typename Fn>
+void CompactSkipList::for_each(Fn fn) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    for (CompactBlock *block = _header->forward[0]; block != NULL; block = block->forward[0]) {
+        CompactCursor cursor(block->data);
+        while (cursor.next()) {
+            fn(cursor.key(), cursor.value());
+        }
+    }
+}
+
+inline bool CompactSkipList::dump_snapshot(const std::string& path, bool compress) {
+    SnapshotWriter<std::string, std::string> writer;
+    if (!writer.open(path, compress)) {
+        return false;
+    }
+    bool ok = true;
+    std::string value;
+    for_each([&](const std::string &key, std::string_view v) {
+        value.assign(v.data(), v.size());
+        ok = ok && writer.append(key, value);
+    });
+    return ok && writer.finish();
+}
+
+// 快照有序，逐条插入时总是落在最后一块，仍按普通插入处理；校验时已完整解码过一遍，损坏的文件什么也不加载
+inline bool CompactSkipList::load_snapshot(const std::string& path) {
+    SnapshotReader<std::string, std::string> reader;
+    if (!reader.open(path) || !reader.verify()) {
+        return false;
+    }
+    std::string key;
+    std::string value;
+    SnapshotBlockStatus status;
+    while ((status = reader.read_block([&](std::string_view k, std::string_view v) {
+        key.assign(k.data(), k.size());
+        value.assign(v.data(), v.size());
+        insert_element(key, value);
+    })) == SNAPSHOT_BLOCK_OK) {
+    }
+    return status == SNAPSHOT_BLOCK_END;
+}
+
+// 打印跳表: 每层打印各块的第一个key，第0层打印所有数据
+inline void CompactSkipList::display_list() {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    std::cout << "\n*****Compact Skip List*****"<<"\n";
+    for (int i = _skip_list_level; i >= 1; i--) {
+        std::cout << "Level " << i << ": ";
+        for (CompactBlock *block = _header->forward[i]; block != NULL; block = block->forward[i]) {
+            std::cout << block->first_key() << ";";
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "Level 0: ";
+    for (CompactBlock *block = _header->forward[0]; block != NULL; block = block->forward[0]) {
+        std::cout << "[";
+        CompactCursor cursor(block->data);
+        while (cursor.next()) {
+            std::cout << cursor.key() << ":" << cursor.value() << ";";
+        }
+        std::cout << "]";
+    }
+    std::cout << std::endl;
+}
+
+#endif
+// vim: et tw=100 ts=4 sw=4 cc=120
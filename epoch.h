@@ -0,0 +1,280 @@
+/* ************************************************************************
+> File Name:     epoch.h
+> Description:   基于epoch的内存回收(EBR)，供无锁/读无锁的跳表延迟释放节点
+ ************************************************************************/
+
+#ifndef SKIPLIST_EPOCH_H
+#define SKIPLIST_EPOCH_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define EPOCH_RETIRE_THRESHOLD 64   // 每积攒这么多待回收对象尝试推进一次epoch
+#define EPOCH_INACTIVE UINT64_MAX   // 线程不在临界区
+
+// 待回收的对象
+struct EpochRetired {
+    void *ptr;
+    void (*deleter)(void *ptr, void *ctx);
+    void *ctx;
+    uint64_t epoch;
+};
+
+// 每个线程在某个EpochManager中占用一个槽位
+// 槽位由EpochRegistry统一持有，挂在一条只增不减的链表上；线程退出时把used置回false，槽位留给之后的线程复用。
+struct alignas(64) EpochRecord {
+
+    // 线程进入临界区时记录的全局epoch，不在临界区时为EPOCH_INACTIVE
+    std::atomic<uint64_t> epoch;
+    std::atomic<bool> used;
+    EpochRecord *next;//创建后不再修改
+
+    // 以下字段只由占用该槽位的线程访问
+    int nesting;//临界区嵌套深度
+    std::vector<EpochRetired> limbo;//已摘除、等待安全释放的对象
+
+    EpochRecord() : epoch(EPOCH_INACTIVE), used(true), next(NULL), nesting(0) {}
+};
+
+struct EpochRegistry {
+    EpochRegistry() : head(NULL), orphan_count(0), dead(false) {}
+    ~EpochRegistry() {
+        EpochRecord *rec = head.load(std::memory_order_acquire);
+        while (rec != NULL) {
+            EpochRecord *next = rec->next;
+            delete rec;
+            rec = next;
+        }
+    }
+
+    std::atomic<EpochRecord*> head;
+
+    // 已退出线程留下的待回收对象，由之后任意线程的collect()回收
+    std::mutex orphan_mtx;
+    std::vector<EpochRetired> orphans;
+    std::atomic<size_t> orphan_count;
+    bool dead;//manager已析构，受orphan_mtx保护
+};
+
+// 线程访问过的manager: (manager id, registry, 槽位)
+// 只持有registry的weak_ptr，manager析构后registry随之释放，这里的记录在下次登记新manager时清掉。
+// 线程退出时把仍存活的manager中的槽位归还，limbo交给registry的orphans。
+class EpochThreadSlots {
+public:
+    struct Slot {
+        uint64_t id;
+        std::weak_ptr<EpochRegistry> registry;
+        EpochRecord *record;
+    };
+
+    ~EpochThreadSlots() {
+        for (size_t i = 0; i < slots.size(); i++) {
+            std::shared_ptr<EpochRegistry> registry = slots[i].registry.lock();
+            if (registry == NULL) {
+                continue;
+            }
+            EpochRecord *rec = slots[i].record;
+            {
+                std::lock_guard<std::mutex> lock(registry->orphan_mtx);
+                if (!registry->dead) {
+                    registry->orphans.insert(registry->orphans.end(), rec->limbo.begin(), rec->limbo.end());
+                    registry->orphan_count.store(registry->orphans.size(), std::memory_order_release);
+                }
+                rec->limbo.clear();
+            }
+            rec->nesting = 0;
+            rec->epoch.store(EPOCH_INACTIVE, std::memory_order_release);
+            rec->used.store(false, std::memory_order_release);
+        }
+    }
+
+    // 去掉已析构的manager的记录
+    void prune() {
+        size_t kept = 0;
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (!slots[i].registry.expired()) {
+                slots[kept++] = slots[i];
+            }
+        }
+        slots.resize(kept);
+    }
+
+    std::vector<Slot> slots;
+};
+
+// epoch管理器
+// 对象被摘除后调用retire()，等到所有线程都离开摘除时所在的epoch(全局epoch至少前进两次)之后才真正释放。
+// 参与的线程数不设上限: 槽位不够时新建一个挂到链表上。
+class EpochManager {
+
+public:
+    EpochManager();
+    ~EpochManager();
+
+    // 进入/离开临界区，允许嵌套
+    void enter();
+    void leave();
+
+    // 延迟释放ptr，安全时调用deleter(ptr, ctx)
+    void retire(void *ptr, void (*deleter)(void *, void *), void *ctx);
+
+    // 尝试推进epoch，释放当前线程中以及已退出线程留下的已经安全的对象
+    void collect();
+
+private:
+    EpochRecord *local_record();
+    EpochRecord *acquire_record();
+    bool try_advance();
+    static void reclaim(std::vector<EpochRetired> &limbo, uint64_t safe_epoch);
+
+private:
+    uint64_t _id;
+    std::atomic<uint64_t> _global_epoch;
+    std::shared_ptr<EpochRegistry> _registry;
+};
+
+// RAII形式的临界区
+class EpochGuard {
+public:
+    explicit EpochGuard(EpochManager &mgr) : _mgr(mgr) { _mgr.enter(); }
+    ~EpochGuard() { _mgr.leave(); }
+private:
+    EpochGuard(const EpochGuard &);
+    EpochGuard &operator=(const EpochGuard &);
+    EpochManager &_mgr;
+};
+
+inline uint64_t epoch_next_manager_id() {
+    static std::atomic<uint64_t> next_id(1);
+    return next_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline EpochThreadSlots &epoch_thread_slots() {
+    static thread_local EpochThreadSlots slots;
+    return slots;
+}
+
+inline EpochManager::EpochManager()
+    : _id(epoch_next_manager_id()), _global_epoch(0), _registry(new EpochRegistry()) {
+}
+
+// 析构时要求已经没有线程在使用该manager，直接释放所有残留对象。
+// 之后退出的线程通过dead得知不必再交出limbo；各线程中指向registry的记录随registry释放而失效
+inline EpochManager::~EpochManager() {
+    std::lock_guard<std::mutex> lock(_registry->orphan_mtx);
+    _registry->dead = true;
+    for (EpochRecord *rec = _registry->head.load(std::memory_order_acquire); rec != NULL; rec = rec->next) {
+        for (size_t j = 0; j < rec->limbo.size(); j++) {
+            rec->limbo[j].deleter(rec->limbo[j].ptr, rec->limbo[j].ctx);
+        }
+        rec->limbo.clear();
+    }
+    for (size_t j = 0; j < _registry->orphans.size(); j++) {
+        _registry->orphans[j].deleter(_registry->orphans[j].ptr, _registry->orphans[j].ctx);
+    }
+    _registry->orphans.clear();
+}
+
+// 找到当前线程在该manager中的槽位，第一次访问时登记
+inline EpochRecord *EpochManager::local_record() {
+    EpochThreadSlots &ts = epoch_thread_slots();
+    for (size_t i = 0; i < ts.slots.size(); i++) {
+        if (ts.slots[i].id == _id) {
+            return ts.slots[i].record;
+        }
+    }
+    ts.prune();
+    EpochThreadSlots::Slot slot = {_id, _registry, acquire_record()};
+    ts.slots.push_back(slot);
+    return slot.record;
+}
+
+// 先复用已退出线程归还的槽位，没有时新建一个挂到链表头
+inline EpochRecord *EpochManager::acquire_record() {
+    for (EpochRecord *rec = _registry->head.load(std::memory_order_acquire); rec != NULL; rec = rec->next) {
+        bool expected = false;
+        if (!rec->used.load(std::memory_order_relaxed) &&
+            rec->used.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            return rec;
+        }
+    }
+    EpochRecord *rec = new EpochRecord();
+    EpochRecord *head = _registry->head.load(std::memory_order_relaxed);
+    do {
+        rec->next = head;
+    } while (!_registry->head.compare_exchange_weak(head, rec, std::memory_order_seq_cst));
+    return rec;
+}
+
+inline void EpochManager::enter() {
+    EpochRecord *rec = local_record();
+    if (rec->nesting++ == 0) {
+        // seq_cst保证之后对共享节点的读取不会被重排到发布epoch之前
+        rec->epoch.store(_global_epoch.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+    }
+}
+
+inline void EpochManager::leave() {
+    EpochRecord *rec = local_record();
+    if (--rec->nesting == 0) {
+        rec->epoch.store(EPOCH_INACTIVE, std::memory_order_release);
+    }
+}
+
+inline void EpochManager::retire(void *ptr, void (*deleter)(void *, void *), void *ctx) {
+    EpochRecord *rec = local_record();
+    EpochRetired r = {ptr, deleter, ctx, _global_epoch.load(std::memory_order_acquire)};
+    rec->limbo.push_back(r);
+    if (rec->limbo.size() % EPOCH_RETIRE_THRESHOLD == 0) {
+        collect();
+    }
+}
+
+inline void EpochManager::collect() {
+    try_advance();
+    uint64_t global = _global_epoch.load(std::memory_order_acquire);
+    if (global < 2) {
+        return;
+    }
+    reclaim(local_record()->limbo, global - 2);
+    if (_registry->orphan_count.load(std::memory_order_acquire) != 0) {
+        std::unique_lock<std::mutex> lock(_registry->orphan_mtx, std::try_to_lock);
+        if (lock.owns_lock()) {
+            reclaim(_registry->orphans, global - 2);
+            _registry->orphan_count.store(_registry->orphans.size(), std::memory_order_release);
+        }
+    }
+}
+
+// 所有处于临界区的线程都已看到当前epoch时，才能把全局epoch加一
+inline bool EpochManager::try_advance() {
+    uint64_t global = _global_epoch.load(std::memory_order_seq_cst);
+    for (EpochRecord *rec = _registry->head.load(std::memory_order_seq_cst); rec != NULL; rec = rec->next) {
+        if (!rec->used.load(std::memory_order_acquire)) {
+            continue;
+        }
+        uint64_t e = rec->epoch.load(std::memory_order_seq_cst);
+        if (e != EPOCH_INACTIVE && e != global) {
+            return false;
+        }
+    }
+    return _global_epoch.compare_exchange_strong(global, global + 1, std::memory_order_acq_rel);
+}
+
+// 释放摘除时epoch不大于safe_epoch的对象
+inline void EpochManager::reclaim(std::vector<EpochRetired> &limbo, uint64_t safe_epoch) {
+    size_t kept = 0;
+    for (size_t i = 0; i < limbo.size(); i++) {
+        if (limbo[i].epoch <= safe_epoch) {
+            limbo[i].deleter(limbo[i].ptr, limbo[i].ctx);
+        } else {
+            limbo[kept++] = limbo[i];
+        }
+    }
+    limbo.resize(kept);
+}
+
+#endif
@@ -0,0 +1,370 @@
+/* ************************************************************************
+> File Name:     indexable_skiplist.h
+> Description:   可索引跳表: 每个forward[i]同时记录跨度span[i](沿第0层要走几步)，
+>                在O(log n)内回答"key排第几"和"第k个元素是谁"
+ ************************************************************************/
+
+#ifndef INDEXABLE_SKIPLIST_H
+#define INDEXABLE_SKIPLIST_H
+
+#include <iostream>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <utility>
+#include "random_level.h"
+
+// 可索引跳表的节点
+// 内存布局(一整块): [节点][forward数组][span数组]
+// span[i]为从本节点沿第i层走到forward[i]，在第0层上跨过的节点数；forward[i]为NULL时为到表尾的节点数。
+template<typename K, typename V>
+class IndexNode {
+
+public:
+    template<typename KArg, typename VArg>
+    static IndexNode<K, V>* create(KArg&& k, VArg&& v, int level);
+    static void destroy(IndexNode<K, V> *node);
+
+    const K& get_key() const { return key; }
+    const V& get_value() const { return value; }
+
+    K key;
+    V value;
+    int node_level;
+    IndexNode<K, V> **forward;
+    int *span;
+
+private:
+    template<typename KArg, typename VArg>
+    IndexNode(KArg&& k, VArg&& v) : key(std::forward<KArg>(k)), value(std::forward<VArg>(v)) {}
+};
+
+template<typename K, typename V>
+template<typename KArg, typename VArg>
+IndexNode<K, V>* IndexNode<K, V>::create(KArg&& k, VArg&& v, int level) {
+    size_t bytes = sizeof(IndexNode<K, V>) + (sizeof(IndexNode<K, V>*) + sizeof(int)) * (level + 1);
+    void *mem = ::operator new(bytes);
+    IndexNode<K, V> *node;
+    try {
+        node = new (mem) IndexNode<K, V>(std::forward<KArg>(k), std::forward<VArg>(v));
+    } catch (...) {
+        ::operator delete(mem);
+        throw;
+    }
+    node->node_level = level;
+    node->forward = reinterpret_cast<IndexNode<K, V>**>(node + 1);
+    node->span = reinterpret_cast<int*>(node->forward + level + 1);
+    for (int i = 0; i <= level; i++) {
+        node->forward[i] = NULL;
+        node->span[i] = 0;
+    }
+    return node;
+}
+
+template<typename K, typename V>
+void IndexNode<K, V>::destroy(IndexNode<K, V> *node) {
+    node->~IndexNode<K, V>();
+    ::operator delete(node);
+}
+
+// 可索引跳表类，基本接口与SkipList保持一致
+// 位置(index)从0开始；rank(key)返回key所在的位置，不存在时返回-1
+template <typename K, typename V, typename Compare = std::less<K> >
+class IndexableSkipList {
+
+public:
+    IndexableSkipList(int, const Compare& = Compare());
+    ~IndexableSkipList();
+    int get_random_level();
+    int insert_element(K, V);
+    void display_list();
+    bool search_element(K);
+    bool search_element(K, V*);
+    void delete_element(K);
+    int size();
+
+    // key的位置，O(log n)
+    int rank(const K&);
+    // 第index个元素，越界返回false
+    bool at(int index, K* key, V* value);
+    // 按位置范围扫描: 对位置在[first, last)中的元素按顺序调用fn(key, value)，返回访问的元素数。
+    // 用span一次下降到first，之后沿第0层前进；fn在锁内执行
+    template<typename Fn>
+    int range_by_rank(int first, int last, Fn fn);
+
+private:
+    typedef IndexNode<K, V> NodeType;
+
+    IndexableSkipList(const IndexableSkipList &);
+    IndexableSkipList &operator=(const IndexableSkipList &);
+
+    // 按span下降到第index个节点，越界返回NULL
+    NodeType* node_at(int index);
+
+    bool key_less(const K& a, const K& b) const { return _compare(a, b); }
+    bool key_equal(const K& a, const K& b) const { return !_compare(a, b) && !_compare(b, a); }
+
+private:
+    // 该跳表最大层数
+    int _max_level;
+
+    // 该跳表当前层数
+    int _skip_list_level;
+
+    // 跳表头节点
+    NodeType *_header;
+
+    // 该跳表当前的元素数
+    int _element_count;
+
+    std::mutex _mtx;
+
+    Compare _compare;
+
+    // 新节点的层数
+    LevelGenerator _level_gen;
+};
+
+// 插入元素
+// 下降时用pos[i]记下update[i]在第0层的位置(头节点为0，第一个元素为1)，
+// 新节点在第i层的两段跨度由pos[0]-pos[i]算出；比新节点高的层只是多跨过了一个节点
+template<typename K, typename V, typename Compare>
+int IndexableSkipList<K, V, Compare>::insert_element(K key, V value) {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    NodeType *update[_max_level+1];
+    int pos[_max_level+1];
+    NodeType *current = _header;
+
+    for (int i = _skip_list_level; i >= 0; i--) {
+        pos[i] = (i == _skip_list_level) ? 0 : pos[i+1];
+        while (current->forward[i] != NULL && key_less(current->forward[i]->get_key(), key)) {
+            pos[i] += current->span[i];
+            current = current->forward[i];
+        }
+        update[i] = current;
+    }
+
+    current = current->forward[0];
+    if (current != NULL && key_equal(current->get_key(), key)) {
+        current->value = std::move(value);
+        return 1;
+    }
+
+    int random_level = get_random_level();
+    if (random_level > _skip_list_level) {
+        for (int i = _skip_list_level+1; i <= random_level; i++) {
+            pos[i] = 0;
+            update[i] = _header;
+            update[i]->span[i] = _element_count;//头节点到表尾
+        }
+        _skip_list_level = random_level;
+    }
+
+    NodeType *inserted_node = NodeType::create(std::move(key), std::move(value), random_level);
+    for (int i = 0; i <= random_level; i++) {
+        inserted_node->forward[i] = update[i]->forward[i];
+        update[i]->forward[i] = inserted_node;
+
+        inserted_node->span[i] = update[i]->span[i] - (pos[0] - pos[i]);
+        update[i]->span[i] = (pos[0] - pos[i]) + 1;
+    }
+    for (int i = random_level+1; i <= _skip_list_level; i++) {
+        update[i]->span[i]++;
+    }
+    _element_count++;
+    return 0;
+}
+
+// 打印跳表中的所有数据-每层都打印，括号中为跨度
+template<typename K, typename V, typename Compare>
+void IndexableSkipList<K, V, Compare>::display_list() {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    std::cout << "\n*****Indexable Skip List*****"<<"\n";
+    for (int i = 0; i <= _skip_list_level; i++) {
+        NodeType *node = _header->forward[i];
+        std::cout << "Level " << i << ": (" << _header->span[i] << ") ";
+        while (node != NULL) {
+            std::cout << node->get_key() << ":" << node->get_value() << "(" << node->span[i] << ");";
+            node = node->forward[i];
+        }
+        std::cout << std::endl;
+    }
+}
+
+template<typename K, typename V, typename Compare>
+int IndexableSkipList<K, V, Compare>::size() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _element_count;
+}
+
+// 删除元素
+// 指向被删节点的前驱接手它的跨度；更高层的前驱跨过的节点数减一
+template<typename K, typename V, typename Compare>
+void IndexableSkipList<K, V, Compare>::delete_element(K key) {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    NodeType *update[_max_level+1];
+    NodeType *current = _header;
+
+    for (int i = _skip_list_level; i >= 0; i--) {
+        while (current->forward[i] != NULL && key_less(current->forward[i]->get_key(), key)) {
+            current = current->forward[i];
+        }
+        update[i] = current;
+    }
+
+    current = current->forward[0];
+    if (current == NULL || !key_equal(current->get_key(), key)) {
+        return;
+    }
+
+    for (int i = 0; i <= _skip_list_level; i++) {
+        if (update[i]->forward[i] == current) {
+            update[i]->span[i] += current->span[i] - 1;
+            update[i]->forward[i] = current->forward[i];
+        } else {
+            update[i]->span[i]--;
+        }
+    }
+    NodeType::destroy(current);
+
+    while (_skip_list_level > 0 && _header->forward[_skip_list_level] == NULL) {
+        _header->span[_skip_list_level] = 0;
+        _skip_list_level--;
+    }
+    _element_count--;
+}
+
+template<typename K, typename V, typename Compare>
+bool IndexableSkipList<K, V, Compare>::search_element(K key) {
+    return search_element(key, NULL);
+}
+
+template<typename K, typename V, typename Compare>
+bool IndexableSkipList<K, V, Compare>::search_element(K key, V *value) {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    NodeType *current = _header;
+    for (int i = _skip_list_level; i >= 0; i--) {
+        while (current->forward[i] != NULL && key_less(current->forward[i]->get_key(), key)) {
+            current = current->forward[i];
+        }
+    }
+    current = current->forward[0];
+    if (current != NULL && key_equal(current->get_key(), key)) {
+        if (value != NULL) {
+            *value = current->get_value();
+        }
+        return true;
+    }
+    return false;
+}
+
+// 下降时累加经过的跨度，停在key所在节点时累加值就是它在第0层的位置(从1开始)
+template<typename K, typename V, typename Compare>
+int IndexableSkipList<K, V, Compare>::rank(const K& key) {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    NodeType *current = _header;
+    int traversed = 0;
+    for (int i = _skip_list_level; i >= 0; i--) {
+        while (current->forward[i] != NULL && !key_less(key, current->forward[i]->get_key())) {
+            traversed += current->span[i];
+            current = current->forward[i];
+        }
+        if (current != _header && key_equal(current->get_key(), key)) {
+            return traversed - 1;
+        }
+    }
+    return -1;
+}
+
+template<typename K, typename V, typename Compare>
+IndexNode<K, V>* IndexableSkipList<K, V, Compare>::node_at(int index) {
+
+    if (index < 0 || index >= _element_count) {
+        return NULL;
+    }
+    NodeType *current = _header;
+    int traversed = 0;
+    for (int i = _skip_list_level; i >= 0; i--) {
+        while (current->forward[i] != NULL && traversed + current->span[i] <= index + 1) {
+            traversed += current->span[i];
+            current = current->forward[i];
+        }
+        if (traversed == index + 1) {
+            return current;
+        }
+    }
+    return NULL;
+}
+
+template<typename K, typename V, typename Compare>
+bool IndexableSkipList<K, V, Compare>::at(int index, K* key, V* value) {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    NodeType *node = node_at(index);
+    if (node == NULL) {
+        return false;
+    }
+    if (key != NULL) {
+        *key = node->get_key();
+    }
+    if (value != NULL) {
+        *value = node->get_value();
+    }
+    return true;
+}
+
+template<typename K, typename V, typename Compare>
+template<typename Fn>
+int IndexableSkipList<K, V, Compare>::range_by_rank(int first, int last, Fn fn) {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (first < 0) {
+        first = 0;
+    }
+    int count = 0;
+    NodeType *node = node_at(first);
+    while (node != NULL && first + count < last) {
+        fn(node->get_key(), node->get_value());
+        count++;
+        node = node->forward[0];
+    }
+    return count;
+}
+
+// 跳表的构造函数
+template<typename K, typename V, typename Compare>
+IndexableSkipList<K, V, Compare>::IndexableSkipList(int max_level, const Compare& compare)
+    : _max_level(max_level), _skip_list_level(0), _element_count(0), _compare(compare),
+      _level_gen(max_level) {
+
+    // 创建头节点
+    _header = NodeType::create(K(), V(), _max_level);
+}
+
+// 跳表的析构函数
+template<typename K, typename V, typename Compare>
+IndexableSkipList<K, V, Compare>::~IndexableSkipList() {
+
+    NodeType *node = _header->forward[0];
+    while (node != NULL) {
+        NodeType *next = node->forward[0];
+        NodeType::destroy(node);
+        node = next;
+    }
+    NodeType::destroy(_header);
+}
+
+// 生成随机层数，只在锁内调用
+template<typename K, typename V, typename Compare>
+int IndexableSkipList<K, V, Compare>::get_random_level() {
+    return _level_gen.next();
+}
+
+#endif
+// vim: et tw=100 ts=4 sw=4 cc=120
@@ -0,0 +1,399 @@
+/* ************************************************************************
+> File Name:     lockfree_skiplist.h
+> Description:   无锁并发跳表，forward指针用CAS链接，删除先做逻辑标记，节点经epoch延迟回收
+ ************************************************************************/
+
+#ifndef LOCKFREE_SKIPLIST_H
+#define LOCKFREE_SKIPLIST_H
+
+#include <iostream>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include "epoch.h"
+#include "random_level.h"
+
+// 无锁跳表的节点
+// 节点与forward数组在同一块内存中分配，forward[i]的最低位作为"已删除"标记。
+template<typename K, typename V>
+class LockFreeNode {
+
+public:
+    static LockFreeNode<K, V>* create(const K &k, V *v, int level);
+    static void destroy(LockFreeNode<K, V> *node);
+
+    const K& get_key() const { return key; }
+
+    // 标记位操作
+    static LockFreeNode<K, V>* get_ptr(uintptr_t p) { return reinterpret_cast<LockFreeNode<K, V>*>(p & ~uintptr_t(1)); }
+    static bool is_marked(uintptr_t p) { return (p & 1) != 0; }
+    static uintptr_t make_ref(LockFreeNode<K, V> *n, bool mark) { return reinterpret_cast<uintptr_t>(n) | (mark ? 1 : 0); }
+
+    K key;
+    std::atomic<V*> value;//value单独分配，更新时整体替换并延迟释放旧值
+    int node_level;
+    // 还没结束的一方: 插入方链接完所有层、删除方摘除完之后各减一，减到0的一方把节点交给epoch回收。
+    // 删除方摘除之后，插入方可能还会把节点挂回某一层，只有两方都结束才能确定节点不可达
+    std::atomic<int> pending;
+    std::atomic<uintptr_t> *forward;//指向紧跟在节点后面的[0,level]层指针
+};
+
+template<typename K, typename V>
+LockFreeNode<K, V>* LockFreeNode<K, V>::create(const K &k, V *v, int level) {
+    size_t bytes = sizeof(LockFreeNode<K, V>) + sizeof(std::atomic<uintptr_t>) * (level + 1);
+    void *mem = ::operator new(bytes);
+    LockFreeNode<K, V> *node = new (mem) LockFreeNode<K, V>();
+    node->key = k;
+    node->value.store(v, std::memory_order_relaxed);
+    node->node_level = level;
+    node->pending.store(2, std::memory_order_relaxed);
+    node->forward = reinterpret_cast<std::atomic<uintptr_t>*>(node + 1);
+    for (int i = 0; i <= level; i++) {
+        new (&node->forward[i]) std::atomic<uintptr_t>(0);
+    }
+    return node;
+}
+
+template<typename K, typename V>
+void LockFreeNode<K, V>::destroy(LockFreeNode<K, V> *node) {
+    delete node->value.load(std::memory_order_relaxed);
+    node->~LockFreeNode<K, V>();
+    ::operator delete(node);
+}
+
+// 无锁跳表类，接口与SkipList保持一致
+// 参考Herlihy & Shavit / Fraser的做法:
+// 删除时先从高到低给被删节点的forward[i]打标记(逻辑删除)，标记第0层成功的线程即删除成功；
+// 查找过程中遇到被标记的节点顺手用CAS把它从该层摘掉(物理删除)。
+template <typename K, typename V>
+class LockFreeSkipList {
+
+public:
+    LockFreeSkipList(int);
+    ~LockFreeSkipList();
+    int get_random_level();
+    int insert_element(K, V);
+    void display_list();
+    bool search_element(K);
+    bool search_element(K, V*);
+    void delete_element(K);
+    int size();
+
+private:
+    typedef LockFreeNode<K, V> NodeType;
+
+    bool find(const K &key, NodeType **preds, NodeType **succs);
+    void retire_node(NodeType *node);
+    void release_node(NodeType *node);
+    void retire_value(V *value);
+    static void node_deleter(void *ptr, void *ctx);
+    static void value_deleter(void *ptr, void *ctx);
+
+private:
+    // 该跳表最大层数
+    int _max_level;
+
+    // 该跳表当前层数，只增不减
+    std::atomic<int> _skip_list_level;
+
+    // 跳表头节点
+    NodeType *_header;
+
+    // 该跳表当前的元素数
+    std::atomic<int> _element_count;
+
+    // 被删除节点的延迟回收
+    EpochManager _epoch;
+
+    // 新节点的层数
+    LevelGenerator _level_gen;
+};
+
+// 从上往下查找key，同时记录每层的前驱和后继，遇到被标记的节点就摘除。
+// 若某次摘除的CAS失败，说明前驱已经改变，从头重新查找。
+template<typename K, typename V>
+bool LockFreeSkipList<K, V>::find(const K &key, NodeType **preds, NodeType **succs) {
+
+retry:
+    NodeType *pred = _header;
+    NodeType *curr = NULL;
+    for (int i = _skip_list_level.load(std::memory_order_acquire); i >= 0; i--) {
+        curr = NodeType::get_ptr(pred->forward[i].load(std::memory_order_acquire));
+        while (curr != NULL) {
+            uintptr_t succ = curr->forward[i].load(std::memory_order_acquire);
+            while (NodeType::is_marked(succ)) {
+                // curr已被逻辑删除，把它从第i层摘掉
+                uintptr_t expected = NodeType::make_ref(curr, false);
+                if (!pred->forward[i].compare_exchange_strong(expected, NodeType::make_ref(NodeType::get_ptr(succ), false),
+                                                             std::memory_order_acq_rel)) {
+                    goto retry;
+                }
+                curr = NodeType::get_ptr(succ);
+                if (curr == NULL) {
+                    break;
+                }
+                succ = curr->forward[i].load(std::memory_order_acquire);
+            }
+            if (curr != NULL && curr->get_key() < key) {
+                pred = curr;
+                curr = NodeType::get_ptr(succ);
+            } else {
+                break;
+            }
+        }
+        preds[i] = pred;
+        succs[i] = curr;
+    }
+    return curr != NULL && curr->get_key() == key;
+}
+
+// 插入元素
+// 返回1代表元素存在(并更新value)，返回0代表插入成功
+template<typename K, typename V>
+int LockFreeSkipList<K, V>::insert_element(const K key, const V value) {
+
+    EpochGuard guard(_epoch);
+    NodeType *preds[_max_level+1];
+    NodeType *succs[_max_level+1];
+    for (int i = 0; i <= _max_level; i++) {
+        preds[i] = _header;
+        succs[i] = NULL;
+    }
+
+    int random_level = get_random_level();
+    NodeType *inserted_node = NULL;
+
+    while (true) {
+        if (find(key, preds, succs)) {
+            // key已经存在，替换value
+            V *old = succs[0]->value.exchange(new V(value), std::memory_order_acq_rel);
+            retire_value(old);
+            if (inserted_node != NULL) {
+                NodeType::destroy(inserted_node);
+            }
+            return 1;
+        }
+
+        // 提高当前层数，高出的部分前驱都是头节点
+        int level = _skip_list_level.load(std::memory_order_acquire);
+        while (random_level > level) {
+            if (_skip_list_level.compare_exchange_weak(level, random_level, std::memory_order_acq_rel)) {
+                break;
+            }
+        }
+        for (int i = level + 1; i <= random_level; i++) {
+            preds[i] = _header;
+            succs[i] = NodeType::get_ptr(_header->forward[i].load(std::memory_order_acquire));
+        }
+
+        if (inserted_node == NULL) {
+            inserted_node = NodeType::create(key, new V(value), random_level);
+        }
+        for (int i = 0; i <= random_level; i++) {
+            inserted_node->forward[i].store(NodeType::make_ref(succs[i], false), std::memory_order_relaxed);
+        }
+
+        // 第0层链接成功即完成插入(线性化点)
+        uintptr_t expected = NodeType::make_ref(succs[0], false);
+        if (preds[0]->forward[0].compare_exchange_strong(expected, NodeType::make_ref(inserted_node, false),
+                                                         std::memory_order_acq_rel)) {
+            break;
+        }
+    }
+
+    // 逐层链接上层，前驱变化时重新查找
+    for (int i = 1; i <= random_level; i++) {
+        while (true) {
+            // 先把新节点第i层的后继改为最新的succs[i]；若已被标记说明节点正在被删除，不再继续链接
+            uintptr_t cur = inserted_node->forward[i].load(std::memory_order_acquire);
+            if (NodeType::is_marked(cur)) {
+                goto done;
+            }
+            if (NodeType::get_ptr(cur) != succs[i] &&
+                !inserted_node->forward[i].compare_exchange_strong(cur, NodeType::make_ref(succs[i], false),
+                                                                   std::memory_order_acq_rel)) {
+                goto done;
+            }
+            uintptr_t expected = NodeType::make_ref(succs[i], false);
+            if (preds[i]->forward[i].compare_exchange_strong(expected, NodeType::make_ref(inserted_node, false),
+                                                             std::memory_order_acq_rel)) {
+                break;
+            }
+            if (!find(key, preds, succs) || succs[0] != inserted_node) {
+                goto done;
+            }
+        }
+    }
+
+done:
+    _element_count.fetch_add(1, std::memory_order_relaxed);
+    // 链接过程中若被并发删除，可能把已摘除的节点又挂回了某层，再查找一次确保摘除
+    if (NodeType::is_marked(inserted_node->forward[0].load(std::memory_order_acquire))) {
+        find(key, preds, succs);
+    }
+    release_node(inserted_node);//之后不会再链接，节点已被删除时可能由这里回收
+    return 0;
+}
+
+// 打印跳表中的所有数据-每层都打印(不保证与并发修改一致)
+template<typename K, typename V>
+void LockFreeSkipList<K, V>::display_list() {
+
+    EpochGuard guard(_epoch);
+    std::cout << "\n*****Lock-Free Skip List*****"<<"\n";
+    int level = _skip_list_level.load(std::memory_order_acquire);
+    for (int i = 0; i <= level; i++) {
+        NodeType *node = NodeType::get_ptr(_header->forward[i].load(std::memory_order_acquire));
+        std::cout << "Level " << i << ": ";
+        while (node != NULL) {
+            uintptr_t next = node->forward[i].load(std::memory_order_acquire);
+            if (!NodeType::is_marked(next)) {
+                std::cout << node->get_key() << ":" << *node->value.load(std::memory_order_acquire) << ";";
+            }
+            node = NodeType::get_ptr(next);
+        }
+        std::cout << std::endl;
+    }
+}
+
+// 拿到当前跳表的节点个数
+template<typename K, typename V>
+int LockFreeSkipList<K, V>::size() {
+    return _element_count.load(std::memory_order_relaxed);
+}
+
+// 删除跳表中的元素
+// 先从最高层到第1层依次打标记，再标记第0层，标记第0层成功的线程负责摘除节点；
+// 插入方也结束之后(见LockFreeNode::pending)才回收。
+template<typename K, typename V>
+void LockFreeSkipList<K, V>::delete_element(K key) {
+
+    EpochGuard guard(_epoch);
+    NodeType *preds[_max_level+1];
+    NodeType *succs[_max_level+1];
+
+    if (!find(key, preds, succs)) {
+        return;
+    }
+    NodeType *current = succs[0];
+
+    for (int i = current->node_level; i >= 1; i--) {
+        uintptr_t succ = current->forward[i].load(std::memory_order_acquire);
+        while (!NodeType::is_marked(succ)) {
+            current->forward[i].compare_exchange_weak(succ, succ | 1, std::memory_order_acq_rel);
+        }
+    }
+
+    uintptr_t succ = current->forward[0].load(std::memory_order_acquire);
+    while (true) {
+        if (NodeType::is_marked(succ)) {
+            return;//被其他线程抢先删除
+        }
+        if (current->forward[0].compare_exchange_strong(succ, succ | 1, std::memory_order_acq_rel)) {
+            break;
+        }
+    }
+
+    // 再查找一次，把节点从所有层摘除
+    find(key, preds, succs);
+    _element_count.fetch_sub(1, std::memory_order_relaxed);
+    release_node(current);
+}
+
+// 在跳表中搜索元素，不修改结构，遇到被标记的节点直接跳过
+template<typename K, typename V>
+bool LockFreeSkipList<K, V>::search_element(K key) {
+    return search_element(key, NULL);
+}
+
+template<typename K, typename V>
+bool LockFreeSkipList<K, V>::search_element(K key, V *value) {
+
+    EpochGuard guard(_epoch);
+    NodeType *pred = _header;
+    NodeType *curr = NULL;
+    for (int i = _skip_list_level.load(std::memory_order_acquire); i >= 0; i--) {
+        curr = NodeType::get_ptr(pred->forward[i].load(std::memory_order_acquire));
+        while (curr != NULL) {
+            uintptr_t succ = curr->forward[i].load(std::memory_order_acquire);
+            if (NodeType::is_marked(succ)) {
+                curr = NodeType::get_ptr(succ);
+                continue;
+            }
+            if (curr->get_key() < key) {
+                pred = curr;
+                curr = NodeType::get_ptr(succ);
+            } else {
+                break;
+            }
+        }
+    }
+
+    if (curr != NULL && curr->get_key() == key) {
+        if (value != NULL) {
+            *value = *curr->value.load(std::memory_order_acquire);
+        }
+        return true;
+    }
+    return false;
+}
+
+// 插入方或删除方结束，两方都结束时交给epoch回收
+template<typename K, typename V>
+void LockFreeSkipList<K, V>::release_node(NodeType *node) {
+    if (node->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        retire_node(node);
+    }
+}
+
+template<typename K, typename V>
+void LockFreeSkipList<K, V>::node_deleter(void *ptr, void *) {
+    NodeType::destroy(static_cast<NodeType*>(ptr));
+}
+
+template<typename K, typename V>
+void LockFreeSkipList<K, V>::value_deleter(void *ptr, void *) {
+    delete static_cast<V*>(ptr);
+}
+
+template<typename K, typename V>
+void LockFreeSkipList<K, V>::retire_node(NodeType *node) {
+    _epoch.retire(node, &LockFreeSkipList<K, V>::node_deleter, NULL);
+}
+
+template<typename K, typename V>
+void LockFreeSkipList<K, V>::retire_value(V *value) {
+    _epoch.retire(value, &LockFreeSkipList<K, V>::value_deleter, NULL);
+}
+
+// 跳表的构造函数
+template<typename K, typename V>
+LockFreeSkipList<K, V>::LockFreeSkipList(int max_level)
+    : _max_level(max_level), _skip_list_level(0), _element_count(0), _level_gen(max_level) {
+
+    // 创建头节点
+    _header = NodeType::create(K(), new V(), _max_level);
+}
+
+// 跳表的析构函数，要求此时已没有其他线程访问
+template<typename K, typename V>
+LockFreeSkipList<K, V>::~LockFreeSkipList() {
+
+    NodeType *node = NodeType::get_ptr(_header->forward[0].load(std::memory_order_relaxed));
+    while (node != NULL) {
+        NodeType *next = NodeType::get_ptr(node->forward[0].load(std::memory_order_relaxed));
+        NodeType::destroy(node);
+        node = next;
+    }
+    NodeType::destroy(_header);
+}
+
+// 生成随机层数，随机数状态是线程局部的，可以并发调用
+template<typename K, typename V>
+int LockFreeSkipList<K, V>::get_random_level() {
+    return _level_gen.next();
+}
+
+#endif
+// vim: et tw=100 ts=4 sw=4 cc=120
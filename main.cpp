@@ -11,7 +11,7 @@
 
 int main() {
 
-    // 键值中的key用int型，如果用其他类型，需要自定义比较函数
+    // 键值中的key用int型，如果用其他类型，需要该类型支持operator<，或者通过第三个模板参数传入比较函数
     // 而且如果修改key的类型，同时需要修改skipList.load_file函数
     SkipList<int, std::string> skipList(7);
 	skipList.insert_element(1, "A");
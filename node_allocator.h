@@ -0,0 +1,148 @@
+/* ************************************************************************
+> File Name:     node_allocator.h
+> Description:   跳表节点的内存分配策略
+>                节点和它的forward数组放在同一块连续内存中，块的大小只取决于节点层数
+>                HeapBytes估算key/value在节点之外占用的堆内存
+ ************************************************************************/
+
+#ifndef NODE_ALLOCATOR_H
+#define NODE_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <string>
+
+// 默认策略: 每个节点一次::operator new
+class HeapNodeAllocator {
+public:
+    void* allocate(size_t bytes, int level) {
+        (void)level;
+        return ::operator new(bytes);
+    }
+    void deallocate(void *ptr, size_t bytes, int level) {
+        (void)bytes;
+        (void)level;
+        ::operator delete(ptr);
+    }
+    bool operator==(const HeapNodeAllocator &) const { return true; }
+    bool operator!=(const HeapNodeAllocator &) const { return false; }
+};
+
+#define ARENA_CHUNK_SIZE (1 << 20)  // 每次向系统申请1MB
+#define ARENA_ALIGN 16              // 块大小按16字节对齐分档
+
+// 按块大小分档的slab/bump分配器
+// 新块从当前chunk中顺序切出(bump)，delete_element释放的块挂到同档位的空闲链表上，下次优先复用。
+// 同一层数的节点块大小相同，所以每档空闲链表实际上对应一个层数。
+// 拷贝分配器会共享同一个arena(split_at/merge要求两个跳表的分配器相等，即共享arena)。
+// 各跳表只在自己的锁内调用分配器，共享arena的两个跳表却可能同时分配，所以arena自带一把锁；
+// 不共享时这把锁没有竞争。
+class ArenaNodeAllocator {
+
+public:
+    ArenaNodeAllocator() : _state(new State()) {}
+
+    void* allocate(size_t bytes, int level);
+    void deallocate(void *ptr, size_t bytes, int level);
+
+    // 已向系统申请的字节数
+    size_t reserved_bytes() const {
+        std::lock_guard<std::mutex> lock(_state->mtx);
+        return _state->chunks.size() * static_cast<size_t>(ARENA_CHUNK_SIZE);
+    }
+
+    bool operator==(const ArenaNodeAllocator &other) const { return _state == other._state; }
+    bool operator!=(const ArenaNodeAllocator &other) const { return _state != other._state; }
+
+private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    struct State {
+        State() : cursor(NULL), end(NULL) {}
+        ~State() {
+            for (size_t i = 0; i < chunks.size(); i++) {
+                std::free(chunks[i]);
+            }
+        }
+        std::vector<char*> chunks;
+        std::vector<FreeBlock*> free_lists;//下标为块大小/ARENA_ALIGN
+        char *cursor;//当前chunk中下一个可用位置
+        char *end;
+        std::mutex mtx;
+    };
+
+    static size_t size_class(size_t bytes) { return (bytes + ARENA_ALIGN - 1) / ARENA_ALIGN; }
+
+    std::shared_ptr<State> _state;
+};
+
+inline void* ArenaNodeAllocator::allocate(size_t bytes, int level) {
+    (void)level;
+    size_t cls = size_class(bytes);
+    State &s = *_state;
+    std::lock_guard<std::mutex> lock(s.mtx);
+
+    // 先从空闲链表中复用
+    if (cls < s.free_lists.size() && s.free_lists[cls] != NULL) {
+        FreeBlock *block = s.free_lists[cls];
+        s.free_lists[cls] = block->next;
+        return block;
+    }
+
+    size_t size = cls * ARENA_ALIGN;
+    if (size > ARENA_CHUNK_SIZE) {
+        return ::operator new(bytes);//超大块不走arena，理论上不会出现
+    }
+    if (s.cursor == NULL || static_cast<size_t>(s.end - s.cursor) < size) {
+        char *chunk = static_cast<char*>(std::malloc(ARENA_CHUNK_SIZE));
+        if (chunk == NULL) {
+            throw std::bad_alloc();
+        }
+        s.chunks.push_back(chunk);
+        s.cursor = chunk;
+        s.end = chunk + ARENA_CHUNK_SIZE;
+    }
+    void *ptr = s.cursor;
+    s.cursor += size;
+    return ptr;
+}
+
+inline void ArenaNodeAllocator::deallocate(void *ptr, size_t bytes, int level) {
+    (void)level;
+    size_t cls = size_class(bytes);
+    if (cls * ARENA_ALIGN > ARENA_CHUNK_SIZE) {
+        ::operator delete(ptr);
+        return;
+    }
+    State &s = *_state;
+    std::lock_guard<std::mutex> lock(s.mtx);
+    if (cls >= s.free_lists.size()) {
+        s.free_lists.resize(cls + 1, NULL);
+    }
+    FreeBlock *block = static_cast<FreeBlock*>(ptr);
+    block->next = s.free_lists[cls];
+    s.free_lists[cls] = block;
+}
+
+// 对象在自身之外占用的堆内存，用于估算内存。自定义类型可以特化
+template<typename T>
+struct HeapBytes {
+    static size_t of(const T &) { return 0; }
+};
+
+// 容量不超过默认构造的字符串时数据在对象内(短字符串优化)，这个长度各标准库不同
+template<>
+struct HeapBytes<std::string> {
+    static size_t of(const std::string &s) {
+        static const size_t inline_capacity = std::string().capacity();
+        return s.capacity() > inline_capacity ? s.capacity() + 1 : 0;
+    }
+};
+
+#endif
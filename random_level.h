@@ -0,0 +1,94 @@
+/* ************************************************************************
+> File Name:     random_level.h
+> Description:   节点层数生成: 每个线程独立的xorshift随机数，一次取一个64位随机数得到层数
+>                层数从0开始，节点升到第k层及以上的概率为p^k
+ ************************************************************************/
+
+#ifndef SKIPLIST_RANDOM_LEVEL_H
+#define SKIPLIST_RANDOM_LEVEL_H
+
+#include <cstdint>
+#include <cmath>
+#include <chrono>
+
+#define SKIPLIST_P_HALF 0.5
+#define SKIPLIST_P_QUARTER 0.25
+#define SKIPLIST_P_INV_E 0.36787944117144233   // 1/e
+
+// 当前线程的xorshift64随机数
+// 状态为线程局部变量，不同线程、不同跳表之间没有共享数据，也不需要加锁。
+// 第一次使用时用状态的地址和时钟混合出种子(splitmix64)，每个线程、每次运行的序列都不同
+inline uint64_t thread_random() {
+    static thread_local uint64_t state = 0;
+    if (state == 0) {
+        uint64_t z = reinterpret_cast<uintptr_t>(&state) ^
+                     static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        z += 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        z ^= z >> 31;
+        state = z != 0 ? z : 0x9E3779B97F4A7C15ULL;
+    }
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// 层数生成器
+// p为1/2^m时，随机数末尾连续的0每m个升一层，用一次count-trailing-zeros算出层数；
+// 其他p(如1/e)预先算好阈值_threshold[k] = p^(k+1) * 2^64，随机数小于阈值就至少升到第k+1层。
+// 两种方式都只取一个随机数。
+class LevelGenerator {
+public:
+    explicit LevelGenerator(int max_level, double p = SKIPLIST_P_HALF) : _max_level(max_level) {
+        set_probability(p);
+    }
+
+    // p取值(0, 1)，超出范围时按1/2处理
+    void set_probability(double p) {
+        if (!(p > 0 && p < 1)) {
+            p = SKIPLIST_P_HALF;
+        }
+        _p = p;
+        _shift = 0;
+        int exponent;
+        if (std::frexp(p, &exponent) == 0.5) {
+            _shift = 1 - exponent;//p = 2^-shift
+        }
+        double threshold = 18446744073709551616.0;//2^64
+        for (int k = 0; k < THRESHOLDS; k++) {
+            threshold *= p;
+            _threshold[k] = threshold >= 18446744073709551615.0 ? UINT64_MAX : static_cast<uint64_t>(threshold);
+        }
+    }
+
+    double probability() const { return _p; }
+
+    void set_max_level(int max_level) { _max_level = max_level; }
+
+    int next() const {
+        uint64_t r = thread_random();
+        int k;
+        if (_shift > 0) {
+            k = __builtin_ctzll(r | (1ULL << 63)) / _shift;
+        } else {
+            // 阈值递减，二分找出大于r的阈值个数，编译为条件传送，没有难以预测的分支
+            k = 0;
+            for (int step = THRESHOLDS / 2; step > 0; step /= 2) {
+                k += r < _threshold[k + step - 1] ? step : 0;
+            }
+        }
+        return k < _max_level ? k : _max_level;//最高层数限制
+    }
+
+private:
+    static const int THRESHOLDS = 64;
+
+    int _max_level;
+    double _p;
+    int _shift;//p = 2^-_shift，为0时按阈值计算
+    uint64_t _threshold[THRESHOLDS];//_threshold[k]: 升到第k+1层的阈值
+};
+
+#endif
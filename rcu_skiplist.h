@@ -0,0 +1,285 @@
+/* ************************************************************************
+> File Name:     rcu_skiplist.h
+> Description:   读写分离的跳表: 读者不加锁，只进入epoch临界区遍历forward；
+>                写者之间用一把写锁串行化，被删除的节点等所有读者离开后才释放
+ ************************************************************************/
+
+#ifndef RCU_SKIPLIST_H
+#define RCU_SKIPLIST_H
+
+#include <iostream>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include "epoch.h"
+#include "random_level.h"
+
+// 读写分离跳表的节点
+// forward为原子指针: 写者用release发布，读者用acquire读取。
+template<typename K, typename V>
+class RcuNode {
+
+public:
+    static RcuNode<K, V>* create(const K &k, V *v, int level);
+    static void destroy(RcuNode<K, V> *node);
+
+    const K& get_key() const { return key; }
+
+    K key;
+    std::atomic<V*> value;//更新value时整体替换，旧值延迟释放
+    int node_level;
+    std::atomic<RcuNode<K, V>*> *forward;//指向紧跟在节点后面的[0,level]层指针
+};
+
+template<typename K, typename V>
+RcuNode<K, V>* RcuNode<K, V>::create(const K &k, V *v, int level) {
+    size_t bytes = sizeof(RcuNode<K, V>) + sizeof(std::atomic<RcuNode<K, V>*>) * (level + 1);
+    void *mem = ::operator new(bytes);
+    RcuNode<K, V> *node = new (mem) RcuNode<K, V>();
+    node->key = k;
+    node->value.store(v, std::memory_order_relaxed);
+    node->node_level = level;
+    node->forward = reinterpret_cast<std::atomic<RcuNode<K, V>*>*>(node + 1);
+    for (int i = 0; i <= level; i++) {
+        new (&node->forward[i]) std::atomic<RcuNode<K, V>*>(static_cast<RcuNode<K, V>*>(NULL));
+    }
+    return node;
+}
+
+template<typename K, typename V>
+void RcuNode<K, V>::destroy(RcuNode<K, V> *node) {
+    delete node->value.load(std::memory_order_relaxed);
+    node->~RcuNode<K, V>();
+    ::operator delete(node);
+}
+
+// 读写分离跳表类，接口与SkipList保持一致
+template <typename K, typename V>
+class RcuSkipList {
+
+public:
+    RcuSkipList(int);
+    ~RcuSkipList();
+    int get_random_level();
+    int insert_element(K, V);
+    void display_list();
+    bool search_element(K);
+    bool search_element(K, V*);
+    void delete_element(K);
+    int size();
+
+private:
+    typedef RcuNode<K, V> NodeType;
+
+    static void node_deleter(void *ptr, void *ctx);
+    static void value_deleter(void *ptr, void *ctx);
+
+private:
+    // 该跳表最大层数
+    int _max_level;
+
+    // 该跳表当前层数
+    std::atomic<int> _skip_list_level;
+
+    // 跳表头节点
+    NodeType *_header;
+
+    // 该跳表当前的元素数
+    std::atomic<int> _element_count;
+
+    // 写者之间互斥
+    std::mutex _write_mtx;
+
+    // 被删除节点/被替换value的延迟回收
+    EpochManager _epoch;
+
+    // 新节点的层数
+    LevelGenerator _level_gen;
+};
+
+// 插入元素
+// 新节点先把自己各层的forward填好，再自底向上发布到前驱上，
+// 读者无论在哪一层看到新节点，它的forward都已经是完整的。
+template<typename K, typename V>
+int RcuSkipList<K, V>::insert_element(const K key, const V value) {
+
+    std::lock_guard<std::mutex> lock(_write_mtx);
+    NodeType *current = _header;
+    NodeType *update[_max_level+1];
+
+    int level = _skip_list_level.load(std::memory_order_relaxed);
+    for (int i = level; i >= 0; i--) {
+        NodeType *next = current->forward[i].load(std::memory_order_relaxed);
+        while (next != NULL && next->get_key() < key) {
+            current = next;
+            next = current->forward[i].load(std::memory_order_relaxed);
+        }
+        update[i] = current;
+    }
+
+    current = current->forward[0].load(std::memory_order_relaxed);
+
+    // 存在该key的节点，替换value，旧value等读者离开后再释放
+    if (current != NULL && current->get_key() == key) {
+        V *old = current->value.exchange(new V(value), std::memory_order_acq_rel);
+        _epoch.retire(old, &RcuSkipList<K, V>::value_deleter, NULL);
+        return 1;
+    }
+
+    int random_level = get_random_level();
+    if (random_level > level) {
+        for (int i = level+1; i < random_level+1; i++) {
+            update[i] = _header;
+        }
+    }
+
+    NodeType *inserted_node = NodeType::create(key, new V(value), random_level);
+    for (int i = 0; i <= random_level; i++) {
+        inserted_node->forward[i].store(update[i]->forward[i].load(std::memory_order_relaxed),
+                                        std::memory_order_relaxed);
+    }
+    for (int i = 0; i <= random_level; i++) {
+        update[i]->forward[i].store(inserted_node, std::memory_order_release);
+    }
+    if (random_level > level) {
+        _skip_list_level.store(random_level, std::memory_order_release);
+    }
+    _element_count.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+// 打印跳表中的所有数据-每层都打印
+template<typename K, typename V>
+void RcuSkipList<K, V>::display_list() {
+
+    EpochGuard guard(_epoch);
+    std::cout << "\n*****RCU Skip List*****"<<"\n";
+    int level = _skip_list_level.load(std::memory_order_acquire);
+    for (int i = 0; i <= level; i++) {
+        NodeType *node = _header->forward[i].load(std::memory_order_acquire);
+        std::cout << "Level " << i << ": ";
+        while (node != NULL) {
+            std::cout << node->get_key() << ":" << *node->value.load(std::memory_order_acquire) << ";";
+            node = node->forward[i].load(std::memory_order_acquire);
+        }
+        std::cout << std::endl;
+    }
+}
+
+// 拿到当前跳表的节点个数
+template<typename K, typename V>
+int RcuSkipList<K, V>::size() {
+    return _element_count.load(std::memory_order_relaxed);
+}
+
+// 删除跳表中的元素
+// 只修改前驱的forward，被删节点自己的forward保持不变，
+// 正停在该节点上的读者仍能沿着它继续往后走。
+template<typename K, typename V>
+void RcuSkipList<K, V>::delete_element(K key) {
+
+    std::lock_guard<std::mutex> lock(_write_mtx);
+    NodeType *current = _header;
+    NodeType *update[_max_level+1];
+
+    int level = _skip_list_level.load(std::memory_order_relaxed);
+    for (int i = level; i >= 0; i--) {
+        NodeType *next = current->forward[i].load(std::memory_order_relaxed);
+        while (next != NULL && next->get_key() < key) {
+            current = next;
+            next = current->forward[i].load(std::memory_order_relaxed);
+        }
+        update[i] = current;
+    }
+
+    current = current->forward[0].load(std::memory_order_relaxed);
+    if (current == NULL || !(current->get_key() == key)) {
+        return;
+    }
+
+    for (int i = current->node_level; i >= 0; i--) {
+        update[i]->forward[i].store(current->forward[i].load(std::memory_order_relaxed),
+                                    std::memory_order_release);
+    }
+
+    while (level > 0 && _header->forward[level].load(std::memory_order_relaxed) == NULL) {
+        level--;
+    }
+    _skip_list_level.store(level, std::memory_order_release);
+    _element_count.fetch_sub(1, std::memory_order_relaxed);
+
+    // 此时仍可能有读者持有current，交给epoch在宽限期之后释放
+    _epoch.retire(current, &RcuSkipList<K, V>::node_deleter, NULL);
+}
+
+// 在跳表中搜索元素，读者不加锁
+template<typename K, typename V>
+bool RcuSkipList<K, V>::search_element(K key) {
+    return search_element(key, NULL);
+}
+
+template<typename K, typename V>
+bool RcuSkipList<K, V>::search_element(K key, V *value) {
+
+    EpochGuard guard(_epoch);
+    NodeType *current = _header;
+
+    for (int i = _skip_list_level.load(std::memory_order_acquire); i >= 0; i--) {
+        NodeType *next = current->forward[i].load(std::memory_order_acquire);
+        while (next != NULL && next->get_key() < key) {
+            current = next;
+            next = current->forward[i].load(std::memory_order_acquire);
+        }
+    }
+
+    current = current->forward[0].load(std::memory_order_acquire);
+    if (current != NULL && current->get_key() == key) {
+        if (value != NULL) {
+            *value = *current->value.load(std::memory_order_acquire);
+        }
+        return true;
+    }
+    return false;
+}
+
+template<typename K, typename V>
+void RcuSkipList<K, V>::node_deleter(void *ptr, void *) {
+    NodeType::destroy(static_cast<NodeType*>(ptr));
+}
+
+template<typename K, typename V>
+void RcuSkipList<K, V>::value_deleter(void *ptr, void *) {
+    delete static_cast<V*>(ptr);
+}
+
+// 跳表的构造函数
+template<typename K, typename V>
+RcuSkipList<K, V>::RcuSkipList(int max_level)
+    : _max_level(max_level), _skip_list_level(0), _element_count(0), _level_gen(max_level) {
+
+    // 创建头节点
+    _header = NodeType::create(K(), new V(), _max_level);
+}
+
+// 跳表的析构函数，要求此时已没有其他线程访问
+template<typename K, typename V>
+RcuSkipList<K, V>::~RcuSkipList() {
+
+    NodeType *node = _header->forward[0].load(std::memory_order_relaxed);
+    while (node != NULL) {
+        NodeType *next = node->forward[0].load(std::memory_order_relaxed);
+        NodeType::destroy(node);
+        node = next;
+    }
+    NodeType::destroy(_header);
+}
+
+// 生成随机层数，只在写锁内调用
+template<typename K, typename V>
+int RcuSkipList<K, V>::get_random_level() {
+    return _level_gen.next();
+}
+
+#endif
+// vim: et tw=100 ts=4 sw=4 cc=120
@@ -0,0 +1,286 @@
+/* ************************************************************************
+> File Name:     serialize.h
+> Description:   快照和日志共用的二进制编码、CRC32C校验和LZ压缩
+>                数值按本机字节序(小端)原样写入，std::string写4字节长度+内容
+ ************************************************************************/
+
+#ifndef SKIPLIST_SERIALIZE_H
+#define SKIPLIST_SERIALIZE_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <type_traits>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <cerrno>
+
+// 编解码特化: encode把value追加到out末尾；decode从[p, end)读出value并前移p，数据不完整时返回false
+template<typename T, typename Enable = void>
+struct Codec;
+
+// 数值类型，按原始字节读写
+template<typename T>
+struct Codec<T, typename std::enable_if<std::is_arithmetic<T>::value>::type> {
+    static void encode(std::string &out, const T &value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    static bool decode(const char *&p, const char *end, T &value) {
+        if (static_cast<size_t>(end - p) < sizeof(T)) {
+            return false;
+        }
+        memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+};
+
+// 字符串，4字节长度前缀，内容中可以包含任意字节(包括':'和'\n')
+template<>
+struct Codec<std::string> {
+    static void encode(std::string &out, const std::string &value) {
+        uint32_t len = static_cast<uint32_t>(value.size());
+        out.append(reinterpret_cast<const char*>(&len), sizeof(len));
+        out.append(value);
+    }
+    static bool decode(const char *&p, const char *end, std::string &value) {
+        std::string_view view;
+        if (!decode_view(p, end, view)) {
+            return false;
+        }
+        value.assign(view.data(), view.size());
+        return true;
+    }
+    // 不拷贝，view指向编码中的内容
+    static bool decode_view(const char *&p, const char *end, std::string_view &view) {
+        uint32_t len;
+        if (static_cast<size_t>(end - p) < sizeof(len)) {
+            return false;
+        }
+        memcpy(&len, p, sizeof(len));
+        if (static_cast<size_t>(end - p) - sizeof(len) < len) {
+            return false;
+        }
+        view = std::string_view(p + sizeof(len), len);
+        p += sizeof(len) + len;
+        return true;
+    }
+};
+
+// 定长整数的追加与读取
+template<typename T>
+inline void put_fixed(std::string &out, T value) {
+    Codec<T>::encode(out, value);
+}
+
+template<typename T>
+inline bool get_fixed(const char *&p, const char *end, T &value) {
+    return Codec<T>::decode(p, end, value);
+}
+
+// CRC32C(Castagnoli多项式)
+// x86上运行时检测SSE4.2，有则用crc32指令，没有则查表；两种实现结果一致，
+// 这样不需要-msse4.2编译也能用上硬件指令。
+struct Crc32cTable {
+    Crc32cTable() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : (c >> 1);
+            }
+            table[i] = c;
+        }
+    }
+    uint32_t table[256];
+};
+
+inline const uint32_t* crc32c_table() {
+    static const Crc32cTable t;//局部静态变量的初始化是线程安全的
+    return t.table;
+}
+
+inline uint32_t crc32c_sw(const char *data, size_t n, uint32_t crc) {
+    const uint32_t *table = crc32c_table();
+    while (n > 0) {
+        crc = table[(crc ^ static_cast<uint8_t>(*data)) & 0xFF] ^ (crc >> 8);
+        data++;
+        n--;
+    }
+    return crc;
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SKIPLIST_HAVE_CRC32C_HW 1
+__attribute__((target("sse4.2")))
+inline uint32_t crc32c_hw(const char *data, size_t n, uint32_t crc) {
+    uint64_t c = crc;
+    while (n >= 8) {
+        uint64_t v;
+        memcpy(&v, data, 8);
+        c = __builtin_ia32_crc32di(c, v);
+        data += 8;
+        n -= 8;
+    }
+    crc = static_cast<uint32_t>(c);
+    while (n > 0) {
+        crc = __builtin_ia32_crc32qi(crc, static_cast<uint8_t>(*data));
+        data++;
+        n--;
+    }
+    return crc;
+}
+#endif
+
+inline uint32_t crc32c(const char *data, size_t n, uint32_t crc = 0) {
+    crc = ~crc;
+#ifdef SKIPLIST_HAVE_CRC32C_HW
+    static const bool hw = __builtin_cpu_supports("sse4.2");
+    crc = hw ? crc32c_hw(data, n, crc) : crc32c_sw(data, n, crc);
+#else
+    crc = crc32c_sw(data, n, crc);
+#endif
+    return ~crc;
+}
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 14
+#define LZ_MAX_OFFSET 65535
+
+// LZ77压缩，格式与LZ4的块格式相同:
+// 若干序列，每个序列为 token + [字面量长度扩展] + 字面量 + 2字节回溯距离 + [匹配长度扩展]，
+// token高4位为字面量长度，低4位为匹配长度-4，为15时后面跟扩展字节(每个255累加，直到小于255的一个)；
+// 最后一个序列只有字面量。用4字节的hash表找上一次出现的位置，重复的短value(如大量相同的"a")压缩率很高。
+inline void lz_put_length(std::string &out, size_t n) {
+    while (n >= 255) {
+        out.push_back(static_cast<char>(255));
+        n -= 255;
+    }
+    out.push_back(static_cast<char>(n));
+}
+
+inline void lz_put_sequence(std::string &out, const char *literal, size_t literal_len, size_t offset,
+                            size_t match_len) {
+    size_t m = match_len >= LZ_MIN_MATCH ? match_len - LZ_MIN_MATCH : 0;
+    uint8_t token = static_cast<uint8_t>(((literal_len < 15 ? literal_len : 15) << 4) | (m < 15 ? m : 15));
+    out.push_back(static_cast<char>(token));
+    if (literal_len >= 15) {
+        lz_put_length(out, literal_len - 15);
+    }
+    out.append(literal, literal_len);
+    if (match_len == 0) {
+        return;//最后一个序列
+    }
+    out.push_back(static_cast<char>(offset & 0xFF));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (m >= 15) {
+        lz_put_length(out, m - 15);
+    }
+}
+
+// 把[src, src+n)压缩后追加到out
+inline void lz_compress(const char *src, size_t n, std::string &out) {
+    std::vector<uint32_t> table(1 << LZ_HASH_BITS, UINT32_MAX);
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + LZ_MIN_MATCH <= n) {
+        uint32_t seq;
+        memcpy(&seq, src + i, sizeof(seq));
+        uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        uint32_t candidate = table[h];
+        table[h] = static_cast<uint32_t>(i);
+        if (candidate == UINT32_MAX || i - candidate > LZ_MAX_OFFSET ||
+            memcmp(src + candidate, src + i, LZ_MIN_MATCH) != 0) {
+            i++;
+            continue;
+        }
+        size_t len = LZ_MIN_MATCH;
+        while (i + len < n && src[candidate + len] == src[i + len]) {
+            len++;
+        }
+        lz_put_sequence(out, src + anchor, i - anchor, i - candidate, len);
+        i += len;
+        anchor = i;
+    }
+    lz_put_sequence(out, src + anchor, n - anchor, 0, 0);
+}
+
+inline bool lz_get_length(const char *&p, const char *end, size_t &n) {
+    uint8_t b;
+    do {
+        if (p == end) {
+            return false;
+        }
+        b = static_cast<uint8_t>(*p++);
+        n += b;
+    } while (b == 255);
+    return true;
+}
+
+// 解压[src, src+n)到dst，解出的长度必须正好是raw_len；数据损坏时返回false，不会越界读写
+inline bool lz_decompress(const char *src, size_t n, char *dst, size_t raw_len) {
+    const char *p = src;
+    const char *end = src + n;
+    size_t out = 0;
+    while (p < end) {
+        uint8_t token = static_cast<uint8_t>(*p++);
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && !lz_get_length(p, end, literal_len)) {
+            return false;
+        }
+        if (static_cast<size_t>(end - p) < literal_len || raw_len - out < literal_len) {
+            return false;
+        }
+        memcpy(dst + out, p, literal_len);
+        p += literal_len;
+        out += literal_len;
+        if (p == end) {
+            break;//最后一个序列
+        }
+        if (end - p < 2) {
+            return false;
+        }
+        size_t offset = static_cast<uint8_t>(p[0]) | (static_cast<size_t>(static_cast<uint8_t>(p[1])) << 8);
+        p += 2;
+        size_t match_len = token & 15;
+        if (match_len == 15 && !lz_get_length(p, end, match_len)) {
+            return false;
+        }
+        match_len += LZ_MIN_MATCH;
+        if (offset == 0 || offset > out || raw_len - out < match_len) {
+            return false;
+        }
+        // 回溯距离可能小于匹配长度(重复的模式)，逐字节复制
+        for (size_t k = 0; k < match_len; k++) {
+            dst[out + k] = dst[out + k - offset];
+        }
+        out += match_len;
+    }
+    return out == raw_len;
+}
+
+// 把iov中的所有数据写完，处理部分写和EINTR
+inline bool write_fully(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        while (iovcnt > 0 && static_cast<size_t>(n) >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+            iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+#endif
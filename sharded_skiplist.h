@@ -0,0 +1,151 @@
+/* ************************************************************************
+> File Name:     sharded_skiplist.h
+> Description:   分片跳表: 按hash或key范围把数据分到N个独立的SkipList上，
+>                每个分片有自己的锁，写吞吐随分片数增加
+ ************************************************************************/
+
+#ifndef SHARDED_SKIPLIST_H
+#define SHARDED_SKIPLIST_H
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include "skiplist.h"
+
+// 按hash分片
+template<typename K>
+class HashPartitioner {
+public:
+    explicit HashPartitioner(int shard_count) : _shard_count(shard_count) {}
+    int shard_count() const { return _shard_count; }
+    int operator()(const K &key) const {
+        return static_cast<int>(std::hash<K>()(key) % static_cast<size_t>(_shard_count));
+    }
+private:
+    int _shard_count;
+};
+
+// 按key范围分片
+// splits为升序的分界点，n个分界点得到n+1个分片: 第i个分片保存[splits[i-1], splits[i])的key。
+// 同一分片内仍然有序，分片之间也有序，适合范围扫描。
+template<typename K>
+class RangePartitioner {
+public:
+    explicit RangePartitioner(const std::vector<K> &splits) : _splits(splits) {}
+    int shard_count() const { return static_cast<int>(_splits.size()) + 1; }
+    int operator()(const K &key) const {
+        return static_cast<int>(std::upper_bound(_splits.begin(), _splits.end(), key) - _splits.begin());
+    }
+private:
+    std::vector<K> _splits;
+};
+
+// 分片跳表类，接口与SkipList保持一致
+template <typename K, typename V, typename Partitioner = HashPartitioner<K> >
+class ShardedSkipList {
+
+public:
+    ShardedSkipList(int max_level, const Partitioner &partitioner);
+    ~ShardedSkipList();
+    int insert_element(K, V);
+    void display_list();
+    bool search_element(K);
+    void delete_element(K);
+    size_t size();
+    // 所有分片统计之和
+    SkipListStats stats();
+
+    int shard_count() const;
+    SkipList<K, V>& shard(int i);
+
+private:
+    ShardedSkipList(const ShardedSkipList &);
+    ShardedSkipList &operator=(const ShardedSkipList &);
+
+    SkipList<K, V>& shard_of(const K &key);
+
+private:
+    Partitioner _partitioner;
+
+    // 各个分片，SkipList持有互斥锁不能拷贝，这里存指针
+    std::vector<SkipList<K, V>*> _shards;
+};
+
+template<typename K, typename V, typename Partitioner>
+ShardedSkipList<K, V, Partitioner>::ShardedSkipList(int max_level, const Partitioner &partitioner)
+    : _partitioner(partitioner) {
+
+    for (int i = 0; i < _partitioner.shard_count(); i++) {
+        _shards.push_back(new SkipList<K, V>(max_level));
+    }
+}
+
+template<typename K, typename V, typename Partitioner>
+ShardedSkipList<K, V, Partitioner>::~ShardedSkipList() {
+    for (size_t i = 0; i < _shards.size(); i++) {
+        delete _shards[i];
+    }
+}
+
+template<typename K, typename V, typename Partitioner>
+SkipList<K, V>& ShardedSkipList<K, V, Partitioner>::shard_of(const K &key) {
+    return *_shards[_partitioner(key)];
+}
+
+// 插入元素，返回值同SkipList::insert_element
+template<typename K, typename V, typename Partitioner>
+int ShardedSkipList<K, V, Partitioner>::insert_element(const K key, const V value) {
+    return shard_of(key).insert_element(key, value);
+}
+
+// 依次打印每个分片
+template<typename K, typename V, typename Partitioner>
+void ShardedSkipList<K, V, Partitioner>::display_list() {
+    for (size_t i = 0; i < _shards.size(); i++) {
+        std::cout << "\n=====Shard " << i << "=====";
+        _shards[i]->display_list();
+    }
+}
+
+template<typename K, typename V, typename Partitioner>
+bool ShardedSkipList<K, V, Partitioner>::search_element(K key) {
+    return shard_of(key).search_element(key);
+}
+
+template<typename K, typename V, typename Partitioner>
+void ShardedSkipList<K, V, Partitioner>::delete_element(K key) {
+    shard_of(key).delete_element(key);
+}
+
+// 所有分片的元素数之和
+template<typename K, typename V, typename Partitioner>
+size_t ShardedSkipList<K, V, Partitioner>::size() {
+    size_t total = 0;
+    for (size_t i = 0; i < _shards.size(); i++) {
+        total += _shards[i]->size();
+    }
+    return total;
+}
+
+template<typename K, typename V, typename Partitioner>
+SkipListStats ShardedSkipList<K, V, Partitioner>::stats() {
+    SkipListStats total;
+    for (size_t i = 0; i < _shards.size(); i++) {
+        total += _shards[i]->stats();
+    }
+    return total;
+}
+
+template<typename K, typename V, typename Partitioner>
+int ShardedSkipList<K, V, Partitioner>::shard_count() const {
+    return static_cast<int>(_shards.size());
+}
+
+template<typename K, typename V, typename Partitioner>
+SkipList<K, V>& ShardedSkipList<K, V, Partitioner>::shard(int i) {
+    return *_shards[i];
+}
+
+#endif
+// vim: et tw=100 ts=4 sw=4 cc=120
@@ -6,20 +6,52 @@
 > Description:   
  ************************************************************************/
 
+#ifndef SKIPLIST_H
+#define SKIPLIST_H
+
 #include <iostream> 
 #include <cstdlib>
 #include <cmath>
 #include <cstring>
 #include <mutex>
 #include <fstream>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include <new>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <iterator>
+#include <cstddef>
+#include <optional>
+#include <memory>
+#include "node_allocator.h"
+#include "snapshot.h"
+#include "wal.h"
+#include "skiplist_stats.h"
+#include "random_level.h"
 
 #define STORE_FILE "store/dumpFile"
+#define DELIMITER ":"   // 文件中key与value的分隔符
+
+// 顺序遍历第0层时提前把后面的节点取进cache
+#if defined(__GNUC__) || defined(__clang__)
+#define SKIPLIST_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define SKIPLIST_PREFETCH(p) ((void)(p))
+#endif
 
-std::mutex mtx;     // 互斥锁
-std::string delimiter = ":";
+#define SKIPLIST_BATCH_INTERLEAVE 16    // find_batch同时推进的查找数
+#define SKIPLIST_LEVEL_LIMIT 63         // 最大层数自动增长的上限
 
 
 // 链表中的节点类
+// 内存布局(一整块): [forward指针|node_level|key][forward数组][value]
+// 查找时只比较key并沿forward前进，这些都集中在块的开头，通常落在同一条cache line里；
+// value放在forward数组之后，不会被遍历过程带进cache。
 template<typename K, typename V> 
 class Node {
 
@@ -27,19 +59,27 @@ public:
     
     Node() {} 
 
-    Node(K k, V v, int); 
+    // 原地构造: key由k转发构造，value由args...转发构造，不产生多余的拷贝
+    template<typename KArg, typename... Args>
+    Node(int level, KArg&& k, Args&&... args);
 
     ~Node();
 
-    K get_key() const;
+    // 节点与forward数组、value一起分配时整块内存的大小
+    static size_t block_size(int level);
 
-    V get_value() const;
+    // 返回引用，比较时不拷贝key(如std::string)
+    const K& get_key() const;
 
-    void set_value(V);
+    const V& get_value() const;
+
+    // 赋值新value，右值直接移动进节点
+    template<typename M>
+    void set_value(M&&);
     
   
     //forward-存储当前结点在i层的下一个结点。
-    //所以初始化forward根据层数初始化空间。
+    //forward数组紧跟在节点对象后面，与节点在同一块内存中，见block_size。
     Node<K, V> **forward;
 //比如，如下所示:key为1的节点，在level=1层的next节点为key为2的节点，所以key为1的节点的forward[1] = key为2的节点指针。
 /*
@@ -52,72 +92,339 @@ level 0:               1:A          2:B         3:C       4:D        5:E     6:F
 
     int node_level;//所在层级
 private:
+    // value在块中的偏移，按V的对齐要求向上取整
+    static size_t value_offset(int level);
+    V* value_ptr() const;
+
     K key;
-    V value;
 };
 
-// 节点的有参构造函数(k,v,所在层级-随机生成)
+// 节点的有参构造函数(所在层级-随机生成, key, 构造value的参数)
 // n层，说明0~n层的每一层都有都有该节点，即可以在其它节点的forward中找到。
+// 只能在大小为block_size(level)的内存块上用placement new构造。
 template<typename K, typename V> 
-Node<K, V>::Node(const K k, const V v, int level) {
-    this->key = k;
-    this->value = v;
+template<typename KArg, typename... Args>
+Node<K, V>::Node(int level, KArg&& k, Args&&... args) : key(std::forward<KArg>(k)) {
     this->node_level = level; 
 
-    //开辟forward数组空间，并使用memset初始化
-    this->forward = new Node<K, V>*[level+1];//初始化大小与层数有关系。[0,level]。
+    //forward数组就在节点后面，使用memset初始化
+    this->forward = reinterpret_cast<Node<K, V>**>(this + 1);//大小与层数有关系。[0,level]。
     memset(this->forward, 0, sizeof(Node<K, V>*)*(level+1));
+
+    //value直接构造在forward数组之后
+    new (value_ptr()) V(std::forward<Args>(args)...);
 };
 
-// 节点的析构
+// 节点的析构，forward数组和value随节点所在的内存块一起释放
 template<typename K, typename V> 
 Node<K, V>::~Node() {
-    delete []forward;
+    value_ptr()->~V();
 };
 
+template<typename K, typename V> 
+size_t Node<K, V>::value_offset(int level) {
+    size_t offset = sizeof(Node<K, V>) + sizeof(Node<K, V>*)*(level+1);
+    return (offset + alignof(V) - 1) / alignof(V) * alignof(V);
+}
+
+template<typename K, typename V> 
+size_t Node<K, V>::block_size(int level) {
+    return value_offset(level) + sizeof(V);
+}
+
+template<typename K, typename V> 
+V* Node<K, V>::value_ptr() const {
+    return reinterpret_cast<V*>(const_cast<char*>(reinterpret_cast<const char*>(this)) + value_offset(node_level));
+}
+
 // 获取节点的key值
 template<typename K, typename V> 
-K Node<K, V>::get_key() const {
+const K& Node<K, V>::get_key() const {
     return key;
 };
 
 // 获取结点value值
 template<typename K, typename V> 
-V Node<K, V>::get_value() const {
-    return value;
+const V& Node<K, V>::get_value() const {
+    return *value_ptr();
 };
 
 // 设置value值
 template<typename K, typename V> 
-void Node<K, V>::set_value(V value) {
-    this->value=value;
+template<typename M>
+void Node<K, V>::set_value(M&& value) {
+    *value_ptr() = std::forward<M>(value);
+};
+
+// 手指: 调用者持有的、上一次操作留下的查找路径
+// 下一次操作从路径上离key最近的一层开始找，不再从头节点的最高层开始；key与上一次相近时
+// (按时间戳、自增ID等近似有序地写入)只需要走常数步。
+// 路径中的指针只在跳表结构(节点的链接)没有变过时有效，每个手指记下操作后的结构版本号，
+// 其他操作插入或删除了节点之后版本号不再相同，这次操作退回到从头查找。
+// 一个手指只能同时被一个线程使用，通常每个线程一个。
+template<typename K, typename V>
+class SkipListFinger {
+public:
+    SkipListFinger() : _owner(NULL), _version(0) {}
+    // 丢弃记住的路径
+    void reset() { _owner = NULL; }
+
+private:
+    template<typename, typename, typename, typename>
+    friend class SkipList;
+
+    const void *_owner;//路径属于哪个跳表
+    uint64_t _version;
+    Node<K, V> *_path[SKIPLIST_LEVEL_LIMIT+1];
 };
 
 // 跳表类
-template <typename K, typename V> 
+// Compare为key的比较函数(严格弱序)，两个key互相都不小于对方即认为相等；
+// 若Compare定义了is_transparent(如std::less<>)，可以直接用其他类型查找，例如用const char*查std::string，
+// 查找过程不构造临时key。
+// Alloc为节点内存分配策略，见node_allocator.h
+template <typename K, typename V, typename Compare = std::less<K>, typename Alloc = HeapNodeAllocator> 
 class SkipList {
 
 public: 
-    SkipList(int);
+    // 沿第0层按key升序的前向迭代器，解引用得到节点(get_key()/get_value())，不能通过它修改value。
+    // 迭代器本身不加锁，遍历期间不能有其他线程修改跳表；并发场景请用range。
+    class iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Node<K, V> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const Node<K, V>* pointer;
+        typedef const Node<K, V>& reference;
+
+        iterator() : _node(NULL) {}
+        explicit iterator(Node<K, V> *node) : _node(node) {}
+
+        reference operator*() const { return *_node; }
+        pointer operator->() const { return _node; }
+        iterator& operator++() {
+            _node = _node->forward[0];
+            if (_node != NULL) {
+                SKIPLIST_PREFETCH(_node->forward[0]);//下一次++要访问的节点
+            }
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator old = *this;
+            ++*this;
+            return old;
+        }
+        bool operator==(const iterator &other) const { return _node == other._node; }
+        bool operator!=(const iterator &other) const { return _node != other._node; }
+
+    private:
+        Node<K, V> *_node;
+    };
+    typedef iterator const_iterator;
+
+    // max_level为初始的最大层数；元素数超过(1/p)^max_level时最大层数自动加一，
+    // 直到SKIPLIST_LEVEL_LIMIT，所以取小一些也不会让查找退化
+    SkipList(int, const Compare& = Compare(), const Alloc& = Alloc());
     ~SkipList();
     int get_random_level();
+    // 节点升一层的概率p(默认1/2，可取SKIPLIST_P_QUARTER、SKIPLIST_P_INV_E等)，只影响之后插入的节点
+    void set_level_probability(double p);
+    double level_probability();
     Node<K, V>* create_node(K, V, int);
+    void destroy_node(Node<K, V>*);
     int insert_element(K, V);
+    // 以下插入接口的返回值与insert_element相同: 1代表key已存在，0代表插入了新节点
+    // key已存在时什么都不做；否则用args...在节点内原地构造value
+    template<typename... Args>
+    int try_emplace(const K&, Args&&...);
+    template<typename... Args>
+    int try_emplace(K&&, Args&&...);
+    // key已存在时把value赋给它；否则插入
+    template<typename M>
+    int insert_or_assign(const K&, M&&);
+    template<typename M>
+    int insert_or_assign(K&&, M&&);
+    // 先用参数构造出key和value再插入，key已存在时丢弃新构造的节点
+    template<typename KArg, typename... Args>
+    int emplace(KArg&&, Args&&...);
+    // 批量插入: 输入为按key升序的(key, value)序列(如dump_file写出的文件)，
+    // 每层只保留一个"手指"指向该层最后链接的节点，整体O(n)建表；乱序的部分退化为普通查找
+    template<typename InputIt>
+    void bulk_load(InputIt first, InputIt last);
+    // 批量插入无序数据: 先按key排序，再按bulk_load的方式归并进跳表；同一key以最后一次出现为准
+    void insert_batch(std::vector<std::pair<K, V> > items);
+    // 有序集合的拼接: 只在每层改一个指针，节点原样移到另一个跳表，不拷贝也不重新分配。
+    // 两个跳表的分配器必须相等(见node_allocator.h)，且都没有打开日志、没有进行中的后台快照，否则返回false。
+    // 把所有不小于key的元素移到other中，other必须为空
+    bool split_at(const K& key, SkipList& other);
+    // 把other的全部元素移到本表，要求两者的key范围不重叠(other整体在本表之前或之后)，成功后other为空
+    bool merge(SkipList& other);
+    // 删除[begin_key, end_key)中的所有元素: 两次下降找到区间两端，每层一次摘下整段，再逐个释放，返回删除的个数
+    size_t erase_range(const K& begin_key, const K& end_key);
     void display_list();
+    iterator begin();
+    iterator end();
+    // 第一个不小于key的位置 / 第一个大于key的位置
+    template<typename KeyLike>
+    iterator lower_bound(const KeyLike&);
+    template<typename KeyLike>
+    iterator upper_bound(const KeyLike&);
+    // 范围扫描: 在锁内对[begin_key, end_key)中的每个元素按key升序调用fn(key, value)，返回访问的元素数。
+    // 只从顶层下降一次找到begin_key，之后沿第0层前进；fn在锁内执行，不能再调用本跳表的接口
+    template<typename KeyLike, typename Fn>
+    int range(const KeyLike& begin_key, const KeyLike& end_key, Fn fn);
     bool search_element(K);
+    // 带手指的插入/查找/删除，语义与不带手指的版本相同
+    typedef SkipListFinger<K, V> Finger;
+    int insert_element(K, V, Finger&);
+    bool search_element(const K&, Finger&);
+    bool delete_element(const K&, Finger&);
+    // 异构查找，只有透明比较函数才可用
+    template<typename KeyLike, typename C = Compare, typename = typename C::is_transparent>
+    bool search_element(const KeyLike&);
+    // 按key取value: 找到时返回value的拷贝(锁外使用安全)，否则返回空
+    std::optional<V> find(const K&);
+    // 找不到时返回default_value
+    V get_or(const K&, const V& default_value);
+    bool contains(const K&);
+    // 以下为异构版本，只有透明比较函数才可用
+    template<typename KeyLike, typename C = Compare, typename = typename C::is_transparent>
+    std::optional<V> find(const KeyLike&);
+    template<typename KeyLike, typename C = Compare, typename = typename C::is_transparent>
+    V get_or(const KeyLike&, const V& default_value);
+    template<typename KeyLike, typename C = Compare, typename = typename C::is_transparent>
+    bool contains(const KeyLike&);
+    // 批量查找: 结果与keys一一对应。先把要查的key排序，在一次加锁内按升序、多个查找交错进行，
+    // 让各个查找的cache miss重叠，见SKIPLIST_BATCH_INTERLEAVE
+    std::vector<std::optional<V> > find_batch(const std::vector<K>& keys);
     void delete_element(K);
-    void dump_file();
-    void load_file();
-    int size();
+    // 文本格式(key:value\n)导出/导入
+    void dump_file(const std::string& path = STORE_FILE);
+    void load_file(const std::string& path = STORE_FILE);
+    // 二进制快照(格式见snapshot.h)，成功返回true
+    bool dump_snapshot(const std::string& path = SNAPSHOT_FILE);
+    bool load_snapshot(const std::string& path = SNAPSHOT_FILE);
+    // 之后写出的快照(包括后台快照和checkpoint)是否按块LZ压缩，默认不压缩；读取时自动识别
+    void set_snapshot_compression(bool compress);
+    // 后台快照: 立即返回，由后台线程把调用这一刻的数据写成二进制快照，期间读写照常进行。
+    // 上一次后台快照还没结束或文件打不开时返回false
+    bool start_snapshot(const std::string& path = SNAPSHOT_FILE);
+    // 等待后台快照结束，返回它是否成功；可以多个线程同时调用
+    bool wait_snapshot();
+    // 预写日志(见wal.h): 打开后每个修改在释放锁之后按policy等待日志落盘
+    bool open_wal(const std::string& path = WAL_FILE, WalSyncPolicy policy = WAL_SYNC_COMMIT);
+    void close_wal();
+    bool sync_wal();
+    // 日志写盘是否失败过。失败后日志不再接受记录，之后的修改只在内存中生效、不再持久，
+    // 调用者应停止写入并用recover重新打开；open_wal/recover成功后清除
+    bool wal_failed();
+    // 崩溃恢复: 加载快照(不存在则跳过)，重放其后的日志，再打开日志继续追加
+    bool recover(const std::string& snapshot_path = SNAPSHOT_FILE, const std::string& wal_path = WAL_FILE,
+                 WalSyncPolicy policy = WAL_SYNC_COMMIT);
+    // 写快照并清空日志，两步在同一次加锁内完成，之间不会漏掉修改
+    bool checkpoint(const std::string& snapshot_path = SNAPSHOT_FILE);
+    size_t size();
+    // 当前的最大层数
+    int max_level();
+    // 运行统计(见skiplist_stats.h)，编译时未定义SKIPLIST_STATS则全为0
+    SkipListStats stats();
+    void reset_stats();
 
 private:
+    template<typename KeyLike>
+    bool search_element_impl(const KeyLike&);
+
+    // 在锁内查找key所在的节点，不存在返回NULL
+    template<typename KeyLike>
+    Node<K, V>* find_node(const KeyLike&);
+    template<typename KeyLike>
+    std::optional<V> find_impl(const KeyLike&);
+    template<typename KeyLike>
+    V get_or_impl(const KeyLike&, const V& default_value);
+    template<typename KeyLike>
+    bool contains_impl(const KeyLike&);
+
+    template<typename KArg, typename... Args>
+    int try_emplace_impl(KArg&&, Args&&...);
+    template<typename KArg, typename M>
+    int insert_or_assign_impl(KArg&&, M&&);
+
+    // 从分配器拿一块内存并原地构造节点
+    template<typename KArg, typename... Args>
+    Node<K, V>* new_node(int level, KArg&&, Args&&...);
+
+    // 查找key的插入位置: update[i]为第i层最后一个key小于key的节点，返回第0层第一个不小于key的节点
+    template<typename KeyLike>
+    Node<K, V>* find_path(const KeyLike&, Node<K, V>** update);
+
+    // 只下降不记录路径: 返回第0层第一个不小于key的节点 / 第一个大于key的节点
+    template<typename KeyLike>
+    Node<K, V>* find_lower(const KeyLike&);
+    template<typename KeyLike>
+    Node<K, V>* find_upper(const KeyLike&);
+
+    // 按随机层数把新节点链接到update之后
+    void link_node(Node<K, V>* node, Node<K, V>** update);
+    // 最大层数的自动增长
+    void grow_level();
+    void update_grow_at();
+    void free_header_forward();
+
+    // 已知update是某个key的完整查找路径(此后结构没有变过)，从路径上最近的一层开始查找，
+    // 而不是每次都从头节点的最高层开始。用于有序批量插入和手指。
+    template<typename KeyLike>
+    Node<K, V>* find_path_from(const KeyLike&, Node<K, V>** update);
+    // 手指的路径仍然有效时从它开始找，否则从头找
+    Node<K, V>* find_path_finger(const K&, Finger&);
+
+    // 在锁内按升序插入一个元素，update为上一次插入留下的路径
+    template<typename KArg, typename M>
+    void sorted_insert(KArg&&, M&&, Node<K, V>** update, bool& has_path, WalCommit<K, V>& commit);
+
+    // 在锁内删除key，返回是否存在
+    bool erase_locked(const K&);
+
+    // 拼接用: 能否与other交换节点；每层最后一个节点(没有则为头节点)；
+    // 把最大层数增长到至少level；去掉顶上的空层
+    bool can_splice(const SkipList& other) const;
+    Node<K, V>* last_node(Node<K, V>** update);
+    void reserve_level(int level);
+    void trim_level();
+    // 把current从update之后摘下并释放
+    void unlink_node(Node<K, V>* current, Node<K, V>** update);
+
+    bool dump_snapshot_locked(const std::string& path);
+
+    // 后台快照线程
+    void snapshot_worker(SnapshotView<K, V, Compare>* view, SnapshotWriter<K, V>* writer);
+    // 在锁内按key升序取出cursor之后的一批记录，已修改过的key取修改前的状态；返回false表示已经读完
+    bool next_snapshot_batch(SnapshotView<K, V, Compare>& view, std::vector<std::pair<K, V> >& batch);
+    // 在锁内修改key之前调用，existing为key当前所在的节点，插入时为NULL
+    void before_write(const K& key, const Node<K, V>* existing);
+
+    // 在锁内记日志，没有打开日志时什么都不做
+    void log_put(WalCommit<K, V>& commit, const K& key, const V& value);
+    void log_delete(WalCommit<K, V>& commit, const K& key);
+    // 释放锁之后等待本次修改的日志落盘，失败时记下，由wal_failed()报告
+    void finish_write(WalCommit<K, V>& commit);
+    size_t erase_range_locked(const K& begin_key, const K& end_key, WalCommit<K, V>& commit);
+
+    // 用Compare比较节点key和查找key
+    template<typename A, typename B>
+    bool key_less(const A& a, const B& b) const { return _compare(a, b); }
+    template<typename A, typename B>
+    bool key_equal(const A& a, const B& b) const { return !_compare(a, b) && !_compare(b, a); }
+
     void get_key_value_from_string(const std::string& str, std::string* key, std::string* value);
     bool is_valid_string(const std::string& str);
 
 private:    
-    // 该跳表最大层数
+    // 该跳表最大层数，随元素数增长
     int _max_level;
 
+    // 元素数达到该值时最大层数加一
+    size_t _grow_at;
+
     // 该跳表当前层数
     int _skip_list_level;
 
@@ -129,14 +436,66 @@ private:
     std::ifstream _file_reader;
 
     // 该跳表当前的元素数
-    int _element_count;
+    size_t _element_count;
+
+    // 结构版本号，每插入或删除一个节点加一，用于判断手指中的路径是否还有效
+    uint64_t _version;
+
+    // 互斥锁，每个跳表实例独立持有，不同实例之间互不竞争
+    std::mutex _mtx;
+
+    // key比较函数
+    Compare _compare;
+
+    // 节点内存分配器
+    Alloc _allocator;
+
+    // 运行统计
+    StatsRecorder _stats;
+
+    // 新节点的层数
+    LevelGenerator _level_gen;
+
+    // 预写日志，NULL表示不记日志
+    std::shared_ptr<MutationLog<K, V> > _wal;
+    std::atomic<bool> _wal_failed;
+
+    // 正在进行的后台快照，NULL表示写者不需要保存旧值
+    SnapshotCapture<K, V> *_snapshot;
+    // 后台快照线程只由start_snapshot(锁内)和析构函数回收，wait_snapshot只等待_snapshot_done
+    std::thread _snapshot_thread;
+    std::condition_variable _snapshot_done;
+    bool _snapshot_running;
+    bool _snapshot_result;
+
+    // 快照是否压缩
+    bool _snapshot_compress;
 };
 
-// 创建一个新节点
-template<typename K, typename V>
-Node<K, V>* SkipList<K, V>::create_node(const K k, const V v, int level) {
-    Node<K, V> *n = new Node<K, V>(k, v, level);
-    return n;
+// 创建一个新节点，节点和forward数组从分配器中一次拿到
+template<typename K, typename V, typename Compare, typename Alloc>
+Node<K, V>* SkipList<K, V, Compare, Alloc>::create_node(K k, V v, int level) {
+    return new_node(level, std::move(k), std::move(v));
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KArg, typename... Args>
+Node<K, V>* SkipList<K, V, Compare, Alloc>::new_node(int level, KArg&& k, Args&&... args) {
+    void *mem = _allocator.allocate(Node<K, V>::block_size(level), level);
+    try {
+        return new (mem) Node<K, V>(level, std::forward<KArg>(k), std::forward<Args>(args)...);
+    } catch (...) {
+        _allocator.deallocate(mem, Node<K, V>::block_size(level), level);
+        throw;
+    }
+}
+
+// 释放节点，内存交还给分配器复用
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::destroy_node(Node<K, V>* node) {
+    int level = node->node_level;
+    node->~Node<K, V>();
+    _allocator.deallocate(node, Node<K, V>::block_size(level), level);
 }
 
 //在跳表中插入元素-详见动画
@@ -163,84 +522,643 @@ level 0         1    4   9 10         30   40  | 50 |  60      70       100
 
 */
 
-// 插入元素
-template<typename K, typename V>
-int SkipList<K, V>::insert_element(const K key, const V value) {
-    
-    mtx.lock();
+// 查找插入位置
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KeyLike>
+Node<K, V>* SkipList<K, V, Compare, Alloc>::find_path(const KeyLike& key, Node<K, V>** update) {
+
     Node<K, V> *current = this->_header;//先拿到头节点
     //头节点是"立体的"，即，它是每一层的头节点。因为有forward[]来控制从哪层出发。
     //而且我们是通过forward将各个节点相关联的。
-  
 
-    //创建update数组并进行初始化
-    //这个update数组存的是——当前层最后一个key小于我们要插入节点的key的节点。
+    //update数组存的是——当前层最后一个key小于我们要插入节点的key的节点。
     //我们要将新节点插入到该节点的后面，即该节点的forward[i]为这个新节点。
     //用于后面再当前层插入&链接新的节点。
-    Node<K, V> *update[_max_level+1];//使用_max_level+1开辟，使空间，肯定够，因为创建节点的时候，会对随机生成的key进行限制。
-    memset(update, 0, sizeof(Node<K, V>*)*(_max_level+1));  
 
     // 从跳表左上角开始查找——_skip_list_level为当前所存在的最高的层(一共有多少层则需要+1,因为是从level=0层开始的)
+    uint64_t comparisons = 0;//只用于统计，未启用统计时被优化掉
     for(int i = _skip_list_level; i >= 0; i--) {//控制当前所在层，从最高层到第0层
        
         //从每一层的最左边开始遍历，如果该节点存在并且，key小于我们要插入的key,继续在该层后移。
-        while(current->forward[i] != NULL && current->forward[i]->get_key() < key) {//是不是继续往后面走
+        while(current->forward[i] != NULL && (++comparisons, key_less(current->forward[i]->get_key(), key))) {//是不是继续往后面走
             current = current->forward[i]; //提示: forward存储该节点在当前层的下一个节点
         }
         update[i] = current;//保存
         //切换下一层
     }
+    _stats.descent(_skip_list_level + 1, comparisons);
 
-    //将current指向第0层第一个key大于要插入节点key的节点。
-    //下面用current用来判断要插入的节点存key是否存在
+    //返回第0层第一个key不小于要插入节点key的节点。
+    //调用者用它来判断要插入的节点存key是否存在
     //即,如果该key不存在的话，准备插入到update[i]后面。存在，则修改该key对应的value。
-    current = current->forward[0];
+    return current->forward[0];
+}
 
-    // 存在该key的节点，修改该节点的值。
-    if (current != NULL && current->get_key() == key) {
-        std::cout << "key: " << key << ", exists" << std::endl;
-        current->set_value(value);//修改原来的key。
-        mtx.unlock();
-        return 1;
-    }
-
-    //不存在key等于要插入key的节点，所以进行插入操作。
-    //如果current节点为null，这就意味着要将该元素应该插入到最后。
-    if (current == NULL || current->get_key() != key ) {
-        
-        // 为当前要插入的节点生成一个随机层数
-        int random_level = get_random_level();
-        
-        //如果随机出来的层数大于当前链表达到的层数，注意:不是最大层，而是当前的最高层_skip_list_level。
-        //更新层数，更新update,准备在每层([0,random_level]层)插入新元素。
-        if (random_level > _skip_list_level) {
-            for (int i = _skip_list_level+1; i < random_level+1; i++) {
-                update[i] = _header;
+// 链接新节点
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::link_node(Node<K, V>* inserted_node, Node<K, V>** update) {
+
+    int random_level = inserted_node->node_level;
+
+    //如果随机出来的层数大于当前链表达到的层数，注意:不是最大层，而是当前的最高层_skip_list_level。
+    //更新层数，更新update,准备在每层([0,random_level]层)插入新元素。
+    if (random_level > _skip_list_level) {
+        for (int i = _skip_list_level+1; i < random_level+1; i++) {
+            update[i] = _header;
+        }
+        _skip_list_level = random_level;
+    }
+
+    // 插入节点
+    for (int i = 0; i <= random_level; i++) {
+        //在每一层([0,random_level])
+        //先将原来的update[i]的forward[i]放入新节点的forward[i]。
+        //再将新节点放入update[i]的forward[i]。
+        inserted_node->forward[i] = update[i]->forward[i];//新节点与后面相链接
+        update[i]->forward[i] = inserted_node;//新节点与前面相链接
+    }
+    _element_count++;//元素总数++
+    _version++;
+    _stats.insert();
+    if (_element_count >= _grow_at) {
+        grow_level();
+    }
+}
+
+// 最大层数加一
+// 头节点本身不重新分配，只把它的forward数组换成更大的一块，调用者手里指向头节点的update[i]仍然有效。
+// 增长只发生在link_node的末尾，此后才生成的层数才可能用到新的一层，按旧_max_level开辟的update数组够用。
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::grow_level() {
+
+    if (_max_level >= SKIPLIST_LEVEL_LIMIT) {
+        _grow_at = static_cast<size_t>(-1);
+        return;
+    }
+    int level = _max_level + 1;
+    Node<K, V> **forward = new Node<K, V>*[level + 1];
+    memcpy(forward, _header->forward, sizeof(Node<K, V>*) * (_max_level + 1));
+    forward[level] = NULL;
+    free_header_forward();
+    _header->forward = forward;
+    _max_level = level;
+    _level_gen.set_max_level(level);
+    update_grow_at();
+}
+
+// 头节点的forward数组不在节点的内存块中时(增长过)，单独释放
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::free_header_forward() {
+    if (_header->forward != reinterpret_cast<Node<K, V>**>(_header + 1)) {
+        delete[] _header->forward;
+    }
+}
+
+// (1/p)^_max_level，超出size_t时不再增长
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::update_grow_at() {
+    double threshold = std::pow(1 / _level_gen.probability(), _max_level);
+    _grow_at = threshold < 1.8e19 ? static_cast<size_t>(std::ceil(threshold)) : static_cast<size_t>(-1);
+    if (_element_count >= _grow_at) {
+        grow_level();
+    }
+}
+
+// 插入元素
+// key和value按值传入，之后一路移动进节点，调用者传右值时不产生拷贝
+template<typename K, typename V, typename Compare, typename Alloc>
+int SkipList<K, V, Compare, Alloc>::insert_element(K key, V value) {
+    
+    WalCommit<K, V> commit;
+    int result = 1;
+    {
+        StatsLockGuard lock(_mtx, _stats);
+
+        //创建update数组
+        Node<K, V> *update[_max_level+1];//使用_max_level+1开辟，使空间，肯定够，因为创建节点的时候，会对随机生成的key进行限制。
+        Node<K, V> *current = find_path(key, update);
+
+        if (current != NULL && key_equal(current->get_key(), key)) {
+            // 存在该key的节点，修改该节点的值。
+            before_write(current->get_key(), current);
+            current->set_value(std::move(value));//修改原来的key。
+            _stats.update();
+            log_put(commit, current->get_key(), current->get_value());
+        } else {
+            //不存在key等于要插入key的节点，所以进行插入操作。
+            //如果current节点为null，这就意味着要将该元素应该插入到最后。
+            // 为当前要插入的节点生成一个随机层数，创建节点并链接
+            Node<K, V>* inserted_node = new_node(get_random_level(), std::move(key), std::move(value));
+            before_write(inserted_node->get_key(), NULL);
+            link_node(inserted_node, update);
+            log_put(commit, inserted_node->get_key(), inserted_node->get_value());
+            result = 0;
+        }
+    }
+    finish_write(commit);//先解锁再等日志落盘
+    return result;
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+Node<K, V>* SkipList<K, V, Compare, Alloc>::find_path_finger(const K& key, Finger& finger) {
+    if (finger._owner != this || finger._version != _version) {
+        finger._owner = this;
+        return find_path(key, finger._path);
+    }
+    return find_path_from(key, finger._path);
+}
+
+// 插入后新节点成为[0,level]层的路径节点，下一个更大的key从它开始找
+template<typename K, typename V, typename Compare, typename Alloc>
+int SkipList<K, V, Compare, Alloc>::insert_element(K key, V value, Finger& finger) {
+
+    WalCommit<K, V> commit;
+    int result = 1;
+    {
+        StatsLockGuard lock(_mtx, _stats);
+        Node<K, V> **update = finger._path;
+        Node<K, V> *current = find_path_finger(key, finger);
+        if (current != NULL && key_equal(current->get_key(), key)) {
+            before_write(current->get_key(), current);
+            current->set_value(std::move(value));
+            _stats.update();
+            log_put(commit, current->get_key(), current->get_value());
+        } else {
+            Node<K, V> *inserted_node = new_node(get_random_level(), std::move(key), std::move(value));
+            before_write(inserted_node->get_key(), NULL);
+            link_node(inserted_node, update);
+            log_put(commit, inserted_node->get_key(), inserted_node->get_value());
+            for (int i = 0; i <= inserted_node->node_level; i++) {
+                update[i] = inserted_node;
             }
-            _skip_list_level = random_level;
+            result = 0;
         }
+        finger._version = _version;
+    }
+    finish_write(commit);
+    return result;
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::search_element(const K& key, Finger& finger) {
 
-        // 创建节点
-        Node<K, V>* inserted_node = create_node(key, value, random_level);
-        
-        // 插入节点
-        for (int i = 0; i <= random_level; i++) {
-            //在每一层([0,random_level])
-            //先将原来的update[i]的forward[i]放入新节点的forward[i]。
-            //再将新节点放入update[i]的forward[i]。
-            inserted_node->forward[i] = update[i]->forward[i];//新节点与后面相链接
-            update[i]->forward[i] = inserted_node;//新节点与前面相链接
+    StatsLockGuard lock(_mtx, _stats);
+    Node<K, V> *current = find_path_finger(key, finger);
+    finger._version = _version;
+    if (current != NULL && key_equal(current->get_key(), key)) {
+        _stats.hit();
+        return true;
+    }
+    _stats.miss();
+    return false;
+}
+
+// 删除后路径仍是key的前驱，只有被删的节点从结构中消失
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::delete_element(const K& key, Finger& finger) {
+
+    WalCommit<K, V> commit;
+    bool found;
+    {
+        StatsLockGuard lock(_mtx, _stats);
+        Node<K, V> *current = find_path_finger(key, finger);
+        found = current != NULL && key_equal(current->get_key(), key);
+        if (found) {
+            unlink_node(current, finger._path);
+            log_delete(commit, key);
         }
-        //std::cout << "Successfully inserted key:" << key << ", value:" << value << std::endl;
-        _element_count++;//元素总数++
+        finger._version = _version;
     }
-    mtx.unlock();
-    return 0;
+    finish_write(commit);
+    return found;
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename... Args>
+int SkipList<K, V, Compare, Alloc>::try_emplace(const K& key, Args&&... args) {
+    return try_emplace_impl(key, std::forward<Args>(args)...);
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename... Args>
+int SkipList<K, V, Compare, Alloc>::try_emplace(K&& key, Args&&... args) {
+    return try_emplace_impl(std::move(key), std::forward<Args>(args)...);
+}
+
+// 先查找，只有key不存在时才构造节点，args不会被消耗
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KArg, typename... Args>
+int SkipList<K, V, Compare, Alloc>::try_emplace_impl(KArg&& key, Args&&... args) {
+
+    WalCommit<K, V> commit;
+    int result = 1;
+    {
+        StatsLockGuard lock(_mtx, _stats);
+        Node<K, V> *update[_max_level+1];
+        Node<K, V> *current = find_path(key, update);
+        if (current == NULL || !key_equal(current->get_key(), key)) {
+            Node<K, V> *node = new_node(get_random_level(), std::forward<KArg>(key), std::forward<Args>(args)...);
+            before_write(node->get_key(), NULL);
+            link_node(node, update);
+            log_put(commit, node->get_key(), node->get_value());
+            result = 0;
+        }
+    }
+    finish_write(commit);
+    return result;
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename M>
+int SkipList<K, V, Compare, Alloc>::insert_or_assign(const K& key, M&& value) {
+    return insert_or_assign_impl(key, std::forward<M>(value));
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename M>
+int SkipList<K, V, Compare, Alloc>::insert_or_assign(K&& key, M&& value) {
+    return insert_or_assign_impl(std::move(key), std::forward<M>(value));
+}
+
+// 与insert_element语义相同，但不打印，value按引用转发
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KArg, typename M>
+int SkipList<K, V, Compare, Alloc>::insert_or_assign_impl(KArg&& key, M&& value) {
+
+    WalCommit<K, V> commit;
+    int result = 1;
+    {
+        StatsLockGuard lock(_mtx, _stats);
+        Node<K, V> *update[_max_level+1];
+        Node<K, V> *current = find_path(key, update);
+        if (current != NULL && key_equal(current->get_key(), key)) {
+            before_write(current->get_key(), current);
+            current->set_value(std::forward<M>(value));
+            _stats.update();
+            log_put(commit, current->get_key(), current->get_value());
+        } else {
+            Node<K, V> *node = new_node(get_random_level(), std::forward<KArg>(key), std::forward<M>(value));
+            before_write(node->get_key(), NULL);
+            link_node(node, update);
+            log_put(commit, node->get_key(), node->get_value());
+            result = 0;
+        }
+    }
+    finish_write(commit);
+    return result;
+}
+
+// 先构造出节点拿到key再查找，key已存在时直接销毁
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KArg, typename... Args>
+int SkipList<K, V, Compare, Alloc>::emplace(KArg&& key, Args&&... args) {
+
+    WalCommit<K, V> commit;
+    int result = 1;
+    {
+        StatsLockGuard lock(_mtx, _stats);
+        Node<K, V> *node = new_node(get_random_level(), std::forward<KArg>(key), std::forward<Args>(args)...);
+        Node<K, V> *update[_max_level+1];
+        Node<K, V> *current = find_path(node->get_key(), update);
+        if (current != NULL && key_equal(current->get_key(), node->get_key())) {
+            destroy_node(node);
+        } else {
+            before_write(node->get_key(), NULL);
+            link_node(node, update);
+            log_put(commit, node->get_key(), node->get_value());
+            result = 0;
+        }
+    }
+    finish_write(commit);
+    return result;
+}
+
+// 沿上一次的查找路径继续查找
+// update[i]为上一个key在第i层的前驱。先从第0层往上找到第一个"下一个节点已经不小于key"的层h，
+// 高于h的层前驱不变；再从h层往下，每层取已走到的节点和update[i]中靠后的一个继续前进。
+// key递增插入(追加)时h通常为0，一次查找只需O(1)。
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KeyLike>
+Node<K, V>* SkipList<K, V, Compare, Alloc>::find_path_from(const KeyLike& key, Node<K, V>** update) {
+
+    // 找最低的一层h，这一层的路径节点在key之前、且它的后继不在key之前：
+    // 从这里开始往下找就不会走过头，也不会漏掉节点。
+    // key在原路径的key之后时，各层路径节点都在key之前，只需检查后继；
+    // 否则各层的后继都在原key之后，只需检查路径节点。满足条件的层之上也都满足，
+    // 所以按0,1,3,7...倍增试探再二分，key离得远时也只需O(log(层数))次比较
+    uint64_t comparisons = 0;
+    bool forward = update[0] == _header || (++comparisons, key_less(update[0]->get_key(), key));
+    auto stop = [&](int level) {
+        if (level >= _skip_list_level) {
+            return true;
+        }
+        ++comparisons;
+        if (forward) {
+            return update[level]->forward[level] == NULL || !key_less(update[level]->forward[level]->get_key(), key);
+        }
+        return update[level] == _header || key_less(update[level]->get_key(), key);
+    };
+    int lo = -1;
+    int h = 0;
+    while (!stop(h)) {
+        lo = h;
+        h = h * 2 + 1 < _skip_list_level ? h * 2 + 1 : _skip_list_level;
+    }
+    while (h - lo > 1) {
+        int mid = (lo + h) / 2;
+        if (stop(mid)) {
+            h = mid;
+        } else {
+            lo = mid;
+        }
+    }
+    if (h >= _skip_list_level) {
+        // 离原路径太远，路径帮不上忙，直接从头节点找，省掉下面逐层挑起点的比较
+        return find_path(key, update);
+    }
+
+    // 每层从上一层停下的节点和本层路径节点中靠后、且仍在key之前的那个出发
+    Node<K, V> *current = _header;
+    for (int i = h; i >= 0; i--) {
+        Node<K, V> *start = update[i];
+        if (start != _header && start != current &&
+            (current == _header || key_less(current->get_key(), start->get_key())) &&
+            (forward || (++comparisons, key_less(start->get_key(), key)))) {
+            current = start;
+        }
+        while (current->forward[i] != NULL && (++comparisons, key_less(current->forward[i]->get_key(), key))) {
+            current = current->forward[i];
+        }
+        update[i] = current;
+    }
+    _stats.descent(h + 1, comparisons);
+    return current->forward[0];
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KArg, typename M>
+void SkipList<K, V, Compare, Alloc>::sorted_insert(KArg&& key, M&& value, Node<K, V>** update, bool& has_path,
+                                                   WalCommit<K, V>& commit) {
+
+    Node<K, V> *current;
+    if (has_path && update[0] != _header && !key_less(update[0]->get_key(), key)) {
+        // 与上一个插入的key相同，直接覆盖
+        if (key_equal(update[0]->get_key(), key)) {
+            before_write(update[0]->get_key(), update[0]);
+            update[0]->set_value(std::forward<M>(value));
+            _stats.update();
+            log_put(commit, update[0]->get_key(), update[0]->get_value());
+            return;
+        }
+        // 输入不是升序(比上一个插入的key小)，只能从头查找
+        has_path = false;
+    }
+    if (!has_path) {
+        current = find_path(key, update);
+        has_path = true;
+    } else {
+        current = find_path_from(key, update);
+    }
+
+    if (current != NULL && key_equal(current->get_key(), key)) {
+        before_write(current->get_key(), current);
+        current->set_value(std::forward<M>(value));
+        _stats.update();
+        log_put(commit, current->get_key(), current->get_value());
+        return;
+    }
+
+    Node<K, V> *inserted_node = new_node(get_random_level(), std::forward<KArg>(key), std::forward<M>(value));
+    before_write(inserted_node->get_key(), NULL);
+    link_node(inserted_node, update);
+    log_put(commit, inserted_node->get_key(), inserted_node->get_value());
+    // 新节点成为[0,level]层新的前驱，下一个更大的key从它开始找
+    for (int i = 0; i <= inserted_node->node_level; i++) {
+        update[i] = inserted_node;
+    }
+}
+
+// 有序批量插入，整个过程只加一次锁，日志也只在最后提交一次
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename InputIt>
+void SkipList<K, V, Compare, Alloc>::bulk_load(InputIt first, InputIt last) {
+
+    WalCommit<K, V> commit;
+    {
+        StatsLockGuard lock(_mtx, _stats);
+        Node<K, V> *update[SKIPLIST_LEVEL_LIMIT+1];//插入过程中最大层数可能增长，update要跨多次插入使用
+        bool has_path = false;
+        for (; first != last; ++first) {
+            auto&& item = *first;
+            sorted_insert(std::forward<decltype(item)>(item).first, std::forward<decltype(item)>(item).second,
+                          update, has_path, commit);
+        }
+    }
+    finish_write(commit);
+}
+
+// 无序批量插入
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::insert_batch(std::vector<std::pair<K, V> > items) {
+
+    // 稳定排序保证相同key按出现顺序插入，最后一次出现的value生效
+    std::stable_sort(items.begin(), items.end(),
+                     [this](const std::pair<K, V>& a, const std::pair<K, V>& b) { return key_less(a.first, b.first); });
+    bulk_load(std::make_move_iterator(items.begin()), std::make_move_iterator(items.end()));
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::can_splice(const SkipList& other) const {
+    return &other != this && _allocator == other._allocator && _wal == NULL && other._wal == NULL &&
+           _snapshot == NULL && other._snapshot == NULL;
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+Node<K, V>* SkipList<K, V, Compare, Alloc>::last_node(Node<K, V>** update) {
+    Node<K, V> *current = _header;
+    for (int i = _skip_list_level; i >= 0; i--) {
+        while (current->forward[i] != NULL) {
+            current = current->forward[i];
+        }
+        update[i] = current;
+    }
+    return current == _header ? NULL : current;
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::reserve_level(int level) {
+    while (_max_level < level) {
+        grow_level();
+    }
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::trim_level() {
+    while (_skip_list_level > 0 && _header->forward[_skip_list_level] == NULL) {
+        _skip_list_level--;
+    }
+}
+
+// 按key切开: 查找路径update[i]之后的部分整段挂到other的头节点上。
+// 移走的元素数从两段的开头同时往后数，先数完的一段决定结果，只走较短一段的长度
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::split_at(const K& key, SkipList& other) {
+
+    if (&other == this) {
+        return false;
+    }
+    // 按地址顺序加锁，两个跳表互相拼接时不会死锁
+    SkipList *first = std::less<SkipList*>()(this, &other) ? this : &other;
+    SkipList *second = first == this ? &other : this;
+    StatsLockGuard lock_first(first->_mtx, first->_stats);
+    StatsLockGuard lock_second(second->_mtx, second->_stats);
+    if (!can_splice(other) || other._element_count != 0) {
+        return false;
+    }
+
+    Node<K, V> *update[_max_level+1];
+    if (find_path(key, update) == NULL) {
+        return true;//没有不小于key的元素
+    }
+    other.reserve_level(_skip_list_level);
+    for (int i = 0; i <= _skip_list_level; i++) {
+        other._header->forward[i] = update[i]->forward[i];
+        update[i]->forward[i] = NULL;
+    }
+    other._skip_list_level = _skip_list_level;
+    other.trim_level();
+    trim_level();
+
+    Node<K, V> *kept = _header->forward[0];
+    Node<K, V> *moved = other._header->forward[0];
+    size_t count = 0;
+    while (kept != NULL && moved != NULL) {
+        kept = kept->forward[0];
+        moved = moved->forward[0];
+        count++;
+    }
+    size_t moved_count = kept == NULL ? _element_count - count : count;
+    _element_count -= moved_count;
+    other._element_count = moved_count;
+    if (other._element_count >= other._grow_at) {
+        other.grow_level();
+    }
+    _version++;
+    other._version++;
+    return true;
+}
+
+// 合并: 在前面的一段每层的最后一个节点接上后面一段该层的第一个节点
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::merge(SkipList& other) {
+
+    if (&other == this) {
+        return false;
+    }
+    SkipList *first = std::less<SkipList*>()(this, &other) ? this : &other;
+    SkipList *second = first == this ? &other : this;
+    StatsLockGuard lock_first(first->_mtx, first->_stats);
+    StatsLockGuard lock_second(second->_mtx, second->_stats);
+    if (!can_splice(other)) {
+        return false;
+    }
+    if (other._element_count == 0) {
+        return true;
+    }
+
+    reserve_level(other._skip_list_level);
+    int level = std::max(_skip_list_level, other._skip_list_level);
+    Node<K, V> *update[_max_level+1];
+    Node<K, V> *last = last_node(update);
+    for (int i = _skip_list_level + 1; i <= level; i++) {
+        update[i] = _header;
+    }
+    Node<K, V> *other_first = other._header->forward[0];
+    if (last == NULL || key_less(last->get_key(), other_first->get_key())) {
+        // other整体在后: 接在本表每层的最后一个节点之后
+        for (int i = 0; i <= other._skip_list_level; i++) {
+            update[i]->forward[i] = other._header->forward[i];
+        }
+    } else {
+        // other整体在前: other每层的最后一个节点接上本表该层的第一个节点
+        Node<K, V> *other_update[other._max_level+1];
+        Node<K, V> *other_last = other.last_node(other_update);
+        if (!key_less(other_last->get_key(), _header->forward[0]->get_key())) {
+            return false;//范围重叠
+        }
+        for (int i = 0; i <= other._skip_list_level; i++) {
+            other_update[i]->forward[i] = _header->forward[i];
+            _header->forward[i] = other._header->forward[i];
+        }
+    }
+    _skip_list_level = level;
+    _element_count += other._element_count;
+    _version++;
+
+    for (int i = 0; i <= other._skip_list_level; i++) {
+        other._header->forward[i] = NULL;
+    }
+    other._skip_list_level = 0;
+    other._element_count = 0;
+    other._version++;
+    if (_element_count >= _grow_at) {
+        grow_level();
+    }
+    return true;
+}
+
+// 区间删除: update_begin[i]之后、update_end[i]之后的节点之前的部分就是第i层上区间内的节点，
+// 每层改一个指针即可整段摘下；被摘下的节点沿第0层逐个释放
+template<typename K, typename V, typename Compare, typename Alloc>
+size_t SkipList<K, V, Compare, Alloc>::erase_range(const K& begin_key, const K& end_key) {
+
+    WalCommit<K, V> commit;
+    size_t count;
+    {
+        StatsLockGuard lock(_mtx, _stats);
+        count = erase_range_locked(begin_key, end_key, commit);
+    }
+    finish_write(commit);
+    return count;
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+size_t SkipList<K, V, Compare, Alloc>::erase_range_locked(const K& begin_key, const K& end_key,
+                                                          WalCommit<K, V>& commit) {
+
+    if (!key_less(begin_key, end_key)) {
+        return 0;
+    }
+    Node<K, V> *update_begin[_max_level+1];
+    Node<K, V> *update_end[_max_level+1];
+    Node<K, V> *node = find_path(begin_key, update_begin);
+    if (node == NULL || !key_less(node->get_key(), end_key)) {
+        return 0;
+    }
+    Node<K, V> *stop = find_path(end_key, update_end);
+    for (int i = 0; i <= _skip_list_level; i++) {
+        update_begin[i]->forward[i] = update_end[i]->forward[i];
+    }
+
+    size_t count = 0;
+    while (node != stop) {
+        Node<K, V> *next = node->forward[0];
+        before_write(node->get_key(), node);
+        log_delete(commit, node->get_key());
+        destroy_node(node);
+        _stats.erase();
+        count++;
+        node = next;
+    }
+    trim_level();
+    _element_count -= count;
+    _version++;
+    return count;
 }
 
 // 打印跳表中的所有数据-每层都打印
-template<typename K, typename V> 
-void SkipList<K, V>::display_list() {
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::display_list() {
 
     std::cout << "\n*****Skip List*****"<<"\n"; 
     //从最低层开始打印
@@ -255,12 +1173,84 @@ void SkipList<K, V>::display_list() {
     }
 }
 
+template<typename K, typename V, typename Compare, typename Alloc>
+typename SkipList<K, V, Compare, Alloc>::iterator SkipList<K, V, Compare, Alloc>::begin() {
+    return iterator(_header->forward[0]);
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+typename SkipList<K, V, Compare, Alloc>::iterator SkipList<K, V, Compare, Alloc>::end() {
+    return iterator();
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KeyLike>
+typename SkipList<K, V, Compare, Alloc>::iterator SkipList<K, V, Compare, Alloc>::lower_bound(const KeyLike& key) {
+    StatsLockGuard lock(_mtx, _stats);
+    return iterator(find_lower(key));
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KeyLike>
+typename SkipList<K, V, Compare, Alloc>::iterator SkipList<K, V, Compare, Alloc>::upper_bound(const KeyLike& key) {
+    StatsLockGuard lock(_mtx, _stats);
+    return iterator(find_upper(key));
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KeyLike>
+Node<K, V>* SkipList<K, V, Compare, Alloc>::find_lower(const KeyLike& key) {
+    Node<K, V> *current = _header;
+    uint64_t comparisons = 0;
+    for (int i = _skip_list_level; i >= 0; i--) {
+        while (current->forward[i] != NULL && (++comparisons, key_less(current->forward[i]->get_key(), key))) {
+            current = current->forward[i];
+        }
+    }
+    _stats.descent(_skip_list_level + 1, comparisons);
+    return current->forward[0];
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KeyLike>
+Node<K, V>* SkipList<K, V, Compare, Alloc>::find_upper(const KeyLike& key) {
+    Node<K, V> *current = _header;
+    uint64_t comparisons = 0;
+    for (int i = _skip_list_level; i >= 0; i--) {
+        while (current->forward[i] != NULL && (++comparisons, !key_less(key, current->forward[i]->get_key()))) {
+            current = current->forward[i];
+        }
+    }
+    _stats.descent(_skip_list_level + 1, comparisons);
+    return current->forward[0];
+}
+
+// 沿第0层扫描时，调用fn之前先预取下一个节点，取数和fn的执行重叠，
+// 到下一轮读它的key和forward时通常已经在cache里
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KeyLike, typename Fn>
+int SkipList<K, V, Compare, Alloc>::range(const KeyLike& begin_key, const KeyLike& end_key, Fn fn) {
+
+    StatsLockGuard lock(_mtx, _stats);
+    int count = 0;
+    Node<K, V> *node = find_lower(begin_key);
+    while (node != NULL && key_less(node->get_key(), end_key)) {
+        Node<K, V> *next = node->forward[0];
+        SKIPLIST_PREFETCH(next);
+        fn(node->get_key(), node->get_value());
+        count++;
+        node = next;
+    }
+    return count;
+}
+
 // 将数据从内存写入文件
-template<typename K, typename V> 
-void SkipList<K, V>::dump_file() {
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::dump_file(const std::string& path) {
 
     std::cout << "dump_file-----------------" << std::endl;
-    _file_writer.open(STORE_FILE);
+    StatsLockGuard lock(_mtx, _stats);//写出期间节点不能被修改或释放；不想挡住写者时用start_snapshot
+    _file_writer.open(path);
     Node<K, V> *node = this->_header->forward[0]; 
 
     //遍历，在第0层中取
@@ -276,100 +1266,434 @@ void SkipList<K, V>::dump_file() {
 }
 
 // 从磁盘中加载数据
-template<typename K, typename V> 
-void SkipList<K, V>::load_file() {
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::load_file(const std::string& path) {
 
-    _file_reader.open(STORE_FILE);
+    _file_reader.open(path);
     std::cout << "load_file-----------------" << std::endl;
     std::string line;
-    std::string* key = new std::string();
-    std::string* value = new std::string();
+    std::string key;
+    std::string value;
+    std::vector<std::pair<std::string, std::string> > items;
     while (getline(_file_reader, line)) {
-        get_key_value_from_string(line, key, value);
-        if (key->empty() || value->empty()) {
+        key.clear();
+        value.clear();
+        get_key_value_from_string(line, &key, &value);
+        if (key.empty() || value.empty()) {
             continue;
         }
-        insert_element(*key, *value);//执行插入函数
-        //std::cout << "key:" << *key << "value:" << *value << std::endl;
+        items.push_back(std::make_pair(key, value));
+        //std::cout << "key:" << key << "value:" << value << std::endl;
     }
     _file_reader.close();
+
+    // dump_file按第0层顺序写出，文件本身有序，一次批量建表
+    bulk_load(std::make_move_iterator(items.begin()), std::make_move_iterator(items.end()));
+}
+
+// 将数据写成二进制快照
+// 沿第0层按key升序写出，块写满后批量写盘；加锁保证写出的是一致的数据
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::dump_snapshot(const std::string& path) {
+
+    StatsLockGuard lock(_mtx, _stats);
+    return dump_snapshot_locked(path);
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::dump_snapshot_locked(const std::string& path) {
+
+    SnapshotWriter<K, V> writer;
+    if (!writer.open(path, _snapshot_compress)) {
+        return false;
+    }
+    Node<K, V> *node = this->_header->forward[0];
+    while (node != NULL) {
+        if (!writer.append(node->get_key(), node->get_value())) {
+            return false;
+        }
+        node = node->forward[0];
+    }
+    return writer.finish();
+}
+
+// 从二进制快照加载
+// 先校验所有块的CRC并完整解码一遍，文件没有问题才开始插入，损坏的文件什么也不加载。
+// 快照本身有序，每个块加一次锁按bulk_load的方式插入；记录从映射的内存直接构造成节点的key和value，
+// 字节只拷贝这一次(节点要持有自己的数据)，不经过中间的(key, value)数组
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::load_snapshot(const std::string& path) {
+
+    SnapshotReader<K, V> reader;
+    if (!reader.open(path) || !reader.verify()) {
+        return false;
+    }
+    SnapshotBlockStatus status;
+    do {
+        WalCommit<K, V> commit;
+        {
+            StatsLockGuard lock(_mtx, _stats);
+            Node<K, V> *update[SKIPLIST_LEVEL_LIMIT+1];
+            bool has_path = false;
+            status = reader.read_block([&](const typename SnapshotReader<K, V>::KeyView& key,
+                                           const typename SnapshotReader<K, V>::ValueView& value) {
+                sorted_insert(K(key), V(value), update, has_path, commit);
+            });
+        }
+        finish_write(commit);
+    } while (status == SNAPSHOT_BLOCK_OK);
+    return status == SNAPSHOT_BLOCK_END;
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::set_snapshot_compression(bool compress) {
+    StatsLockGuard lock(_mtx, _stats);
+    _snapshot_compress = compress;
+}
+
+// 启动后台快照
+// 只在锁内登记快照状态，不复制任何数据；之后的写者负责为快照保留旧值
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::start_snapshot(const std::string& path) {
+
+    StatsLockGuard lock(_mtx, _stats);
+    if (_snapshot_running) {
+        return false;
+    }
+    if (_snapshot_thread.joinable()) {
+        _snapshot_thread.join();//上一次的线程已经结束，只是还没有回收
+    }
+    SnapshotWriter<K, V> *writer = new SnapshotWriter<K, V>();
+    if (!writer->open(path, _snapshot_compress)) {
+        delete writer;
+        return false;
+    }
+    SnapshotView<K, V, Compare> *view = new SnapshotView<K, V, Compare>(_compare);
+    _snapshot = view;
+    _snapshot_running = true;
+    _snapshot_thread = std::thread(&SkipList<K, V, Compare, Alloc>::snapshot_worker, this, view, writer);
+    return true;
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::wait_snapshot() {
+
+    std::unique_lock<std::mutex> lock(_mtx);
+    while (_snapshot_running) {
+        _snapshot_done.wait(lock);
+    }
+    return _snapshot_result;
+}
+
+// 每次加锁只复制一小批记录，编码和写盘都在锁外进行
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::snapshot_worker(SnapshotView<K, V, Compare>* view, SnapshotWriter<K, V>* writer) {
+
+    std::vector<std::pair<K, V> > batch;
+    bool more = true;
+    bool ok = true;
+    while (more && ok) {
+        batch.clear();
+        {
+            StatsLockGuard lock(_mtx, _stats);
+            more = next_snapshot_batch(*view, batch);
+        }
+        for (size_t i = 0; i < batch.size() && ok; i++) {
+            ok = writer->append(batch[i].first, batch[i].second);
+        }
+    }
+    {
+        StatsLockGuard lock(_mtx, _stats);
+        _snapshot = NULL;//之后的写者不再保存旧值
+    }
+    delete view;
+    ok = ok && writer->finish();
+    delete writer;//没有finish时会删掉临时文件
+
+    StatsLockGuard lock(_mtx, _stats);
+    _snapshot_result = ok;
+    _snapshot_running = false;
+    _snapshot_done.notify_all();
+}
+
+// 归并第0层和undo中保存的旧状态: 同一个key以undo为准，undo中修改前不存在的key跳过，
+// undo中有而第0层没有的key(快照开始后被删除)照常写出
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::next_snapshot_batch(SnapshotView<K, V, Compare>& view,
+                                                         std::vector<std::pair<K, V> >& batch) {
+
+    Node<K, V> *node;
+    typename std::map<K, std::pair<bool, V>, Compare>::iterator it;
+    if (!view.has_cursor) {
+        node = _header->forward[0];
+        it = view.undo.begin();
+    } else {
+        Node<K, V> *update[_max_level+1];
+        node = find_path(view.cursor, update);
+        if (node != NULL && key_equal(node->get_key(), view.cursor)) {
+            node = node->forward[0];
+        }
+        it = view.undo.upper_bound(view.cursor);
+        view.undo.erase(view.undo.begin(), it);//cursor之前的key不会再被读到
+    }
+
+    for (int n = 0; n < SNAPSHOT_SCAN_BATCH && (node != NULL || it != view.undo.end()); n++) {
+        if (it == view.undo.end() || (node != NULL && key_less(node->get_key(), it->first))) {
+            batch.push_back(std::make_pair(node->get_key(), node->get_value()));
+            view.cursor = node->get_key();
+            node = node->forward[0];
+        } else {
+            if (node != NULL && key_equal(node->get_key(), it->first)) {
+                node = node->forward[0];
+            }
+            if (it->second.first) {
+                batch.push_back(std::make_pair(it->first, it->second.second));
+            }
+            view.cursor = it->first;
+            ++it;
+        }
+        view.has_cursor = true;
+    }
+    return node != NULL || it != view.undo.end();
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::before_write(const K& key, const Node<K, V>* existing) {
+    if (_snapshot != NULL) {
+        _snapshot->preserve(key, existing != NULL ? &existing->get_value() : NULL);
+    }
+}
+
+// 打开预写日志，已打开的日志先关闭
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::open_wal(const std::string& path, WalSyncPolicy policy) {
+
+    std::shared_ptr<WriteAheadLog<K, V> > wal(new WriteAheadLog<K, V>());
+    if (!wal->open(path, policy)) {
+        return false;
+    }
+    std::shared_ptr<MutationLog<K, V> > old;
+    {
+        StatsLockGuard lock(_mtx, _stats);
+        old.swap(_wal);
+        _wal = wal;
+        _wal_failed.store(false);
+    }
+    if (old != NULL) {
+        old->sync();
+    }
+    return true;
+}
+
+// 关闭日志，关闭前把所有记录写盘
+// 还在等待组提交的写操作持有日志的引用，日志由最后一个引用释放
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::close_wal() {
+
+    std::shared_ptr<MutationLog<K, V> > old;
+    {
+        StatsLockGuard lock(_mtx, _stats);
+        old.swap(_wal);
+    }
+    if (old != NULL) {
+        old->sync();
+    }
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::sync_wal() {
+    std::shared_ptr<MutationLog<K, V> > wal;
+    {
+        StatsLockGuard lock(_mtx, _stats);
+        wal = _wal;
+    }
+    if (wal != NULL && !wal->sync()) {
+        _wal_failed.store(true);
+        return false;
+    }
+    return true;
+}
+
+// 崩溃恢复
+// 日志中的记录都晚于快照，按顺序重放即可；重放时日志还没有打开，不会重复记录
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::recover(const std::string& snapshot_path, const std::string& wal_path,
+                                             WalSyncPolicy policy) {
+
+    close_wal();
+    if (access(snapshot_path.c_str(), F_OK) == 0 && !load_snapshot(snapshot_path)) {
+        return false;
+    }
+    long replayed = WriteAheadLog<K, V>::replay(wal_path, [this](uint8_t op, const K& key, V* value) {
+        if (op == WAL_OP_PUT) {
+            insert_or_assign(key, std::move(*value));
+        } else {
+            StatsLockGuard lock(_mtx, _stats);
+            erase_locked(key);
+        }
+    });
+    if (replayed < 0) {
+        return false;
+    }
+    return open_wal(wal_path, policy);
+}
+
+// 快照写在锁内，日志截断也在锁内，截断前的记录都已包含在快照里
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::checkpoint(const std::string& snapshot_path) {
+
+    StatsLockGuard lock(_mtx, _stats);
+    if (!dump_snapshot_locked(snapshot_path)) {
+        return false;
+    }
+    if (_wal != NULL && !_wal->reset()) {
+        _wal_failed.store(true);
+        return false;
+    }
+    return true;
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::log_put(WalCommit<K, V>& commit, const K& key, const V& value) {
+    if (_wal != NULL) {
+        commit.log = _wal;
+        commit.lsn = _wal->log_put(key, value);
+    }
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::finish_write(WalCommit<K, V>& commit) {
+    if (!commit.wait()) {
+        _wal_failed.store(true);
+    }
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::wal_failed() {
+    return _wal_failed.load();
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::log_delete(WalCommit<K, V>& commit, const K& key) {
+    if (_wal != NULL) {
+        commit.log = _wal;
+        commit.lsn = _wal->log_delete(key);
+    }
 }
 
 // 拿到当前跳表的节点个数
-template<typename K, typename V> 
-int SkipList<K, V>::size() { 
+template<typename K, typename V, typename Compare, typename Alloc>
+size_t SkipList<K, V, Compare, Alloc>::size() { 
     return _element_count;
 }
 
+template<typename K, typename V, typename Compare, typename Alloc>
+int SkipList<K, V, Compare, Alloc>::max_level() {
+    StatsLockGuard lock(_mtx, _stats);
+    return _max_level;
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+SkipListStats SkipList<K, V, Compare, Alloc>::stats() {
+    return _stats.snapshot();
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::reset_stats() {
+    _stats.reset();
+}
+
 // 从文件中的一行读取key和value
-template<typename K, typename V>
-void SkipList<K, V>::get_key_value_from_string(const std::string& str, std::string* key, std::string* value) {
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::get_key_value_from_string(const std::string& str, std::string* key, std::string* value) {
 
     if(!is_valid_string(str)) {
         return;
     }
-    *key = str.substr(0, str.find(delimiter));
-    *value = str.substr(str.find(delimiter)+1, str.length());
+    *key = str.substr(0, str.find(DELIMITER));
+    *value = str.substr(str.find(DELIMITER)+1, str.length());
 }
 
 // 是否是有效的string
-template<typename K, typename V>
-bool SkipList<K, V>::is_valid_string(const std::string& str) {
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::is_valid_string(const std::string& str) {
 
     if (str.empty()) {
         return false;
     }
-    if (str.find(delimiter) == std::string::npos) {
+    if (str.find(DELIMITER) == std::string::npos) {
         return false;
     }
     return true;
 }
 
 // 删除跳表中的元素-根据key值去跳表中查找。
-template<typename K, typename V> 
-void SkipList<K, V>::delete_element(K key) {
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::delete_element(K key) {
+
+    WalCommit<K, V> commit;
+    {
+        StatsLockGuard lock(_mtx, _stats);
+        if (erase_locked(key)) {
+            log_delete(commit, key);
+        }
+    }
+    finish_write(commit);
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::erase_locked(const K& key) {
 
-    mtx.lock();
     Node<K, V> *current = this->_header;//拿到头节点
     Node<K, V> *update[_max_level+1];
     memset(update, 0, sizeof(Node<K, V>*)*(_max_level+1));
 
     // 从最高层开始，同插入函数，这里不多赘述。
+    uint64_t comparisons = 0;
     for (int i = _skip_list_level; i >= 0; i--) {
         //注意是小于，所以等于该key的节点就是update[i]的forward[i]。
-        while (current->forward[i] !=NULL && current->forward[i]->get_key() < key) {
+        while (current->forward[i] !=NULL && (++comparisons, key_less(current->forward[i]->get_key(), key))) {
             current = current->forward[i];
         }
         update[i] = current;
     }
+    _stats.descent(_skip_list_level + 1, comparisons);
 
     current = current->forward[0];//拿到要删除的结点，进行判断，到底是不是。
-    if (current != NULL && current->get_key() == key) {
-       
-        // 从最低层开始
-        for (int i = 0; i <= _skip_list_level; i++) {
+    if (current != NULL && key_equal(current->get_key(), key)) {
+        unlink_node(current, update);
+        return true;
+    }
+    return false;
+}
 
-            // 这里依然要注意update中存的是什么，是我们指定key的节点，在当前层的前一个结点。
-            if (update[i]->forward[i] != current) //如果下一个不是，直接break,因为再往上的层也不会有了。
-                break;
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::unlink_node(Node<K, V>* current, Node<K, V>** update) {
 
-            update[i]->forward[i] = current->forward[i];//跳过current，注意此时并没真正释放。
-        }
-        //释放目标节点内存
-        delete current;
+    before_write(current->get_key(), current);
+   
+    // 从最低层开始
+    for (int i = 0; i <= _skip_list_level; i++) {
 
-        // 从上开始遍历，删除上面的空层，中间的无法删除。(中间的指的是上下册层都有，而它空了的层。)
-        // 即，如果我们删除的元素的level只有它自己。此时删除该结点后，该层就空了。
-        // 这里再次体现出forward的作用，使用header的forward即可判断该层有没有东西。
-        while (_skip_list_level > 0 && _header->forward[_skip_list_level] == 0) {
-            _skip_list_level --; //所在最高层数--
-        }
+        // 这里依然要注意update中存的是什么，是我们指定key的节点，在当前层的前一个结点。
+        if (update[i]->forward[i] != current) //如果下一个不是，直接break,因为再往上的层也不会有了。
+            break;
 
-        std::cout << "Successfully deleted key "<< key << std::endl;
-        _element_count --;//更新元素个数
+        update[i]->forward[i] = current->forward[i];//跳过current，注意此时并没真正释放。
+    }
+    //释放目标节点内存
+    destroy_node(current);
+
+    // 从上开始遍历，删除上面的空层，中间的无法删除。(中间的指的是上下册层都有，而它空了的层。)
+    // 即，如果我们删除的元素的level只有它自己。此时删除该结点后，该层就空了。
+    // 这里再次体现出forward的作用，使用header的forward即可判断该层有没有东西。
+    while (_skip_list_level > 0 && _header->forward[_skip_list_level] == 0) {
+        _skip_list_level --; //所在最高层数--
     }
-    mtx.unlock();
-    return;
+
+    _element_count --;//更新元素个数
+    _version++;
+    _stats.erase();
 }
 
 // Search for element in skip list 
@@ -393,70 +1717,241 @@ level 0         1    4   9 10         30   40    50+-->60      70       100
 */
 
 //在跳表中搜索元素——根据键值进行查找
-template<typename K, typename V> 
-bool SkipList<K, V>::search_element(K key) {
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::search_element(K key) {
+    return search_element_impl(key);
+}
 
-    std::cout << "search_element-----------------" << std::endl;
+// 用可与K比较的类型查找，不构造K
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KeyLike, typename C, typename>
+bool SkipList<K, V, Compare, Alloc>::search_element(const KeyLike& key) {
+    return search_element_impl(key);
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KeyLike>
+bool SkipList<K, V, Compare, Alloc>::search_element_impl(const KeyLike& key) {
+
+    StatsLockGuard lock(_mtx, _stats);//与插入/删除互斥，避免读到修改到一半的forward
     Node<K, V> *current = _header;//拿到头节点
 
     // 从跳表的最高层开始
+    uint64_t comparisons = 0;
     for (int i = _skip_list_level; i >= 0; i--) {
         //同插入元素中的过程，这里略。
-        while (current->forward[i] != nullptr && current->forward[i]->get_key() < key) {
+        while (current->forward[i] != nullptr && (++comparisons, key_less(current->forward[i]->get_key(), key))) {
             current = current->forward[i];
         }
     }
+    _stats.descent(_skip_list_level + 1, comparisons);
 
     //此时current为我们要搜索的结点
     current = current->forward[0];
 
     // 验证键值是否是我们要的
-    if (current and current->get_key() == key) {
-        std::cout << "Found key: " << key << ", value: " << current->get_value() << std::endl;
+    if (current and key_equal(current->get_key(), key)) {
+        _stats.hit();
         return true;
     }
 
-    std::cout << "Not Found Key:" << key << std::endl;
+    _stats.miss();
     return false;
 }
 
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KeyLike>
+Node<K, V>* SkipList<K, V, Compare, Alloc>::find_node(const KeyLike& key) {
+    Node<K, V> *node = find_lower(key);
+    if (node != NULL && key_equal(node->get_key(), key)) {
+        _stats.hit();
+        return node;
+    }
+    _stats.miss();
+    return NULL;
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+std::optional<V> SkipList<K, V, Compare, Alloc>::find(const K& key) {
+    return find_impl(key);
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KeyLike, typename C, typename>
+std::optional<V> SkipList<K, V, Compare, Alloc>::find(const KeyLike& key) {
+    return find_impl(key);
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+V SkipList<K, V, Compare, Alloc>::get_or(const K& key, const V& default_value) {
+    return get_or_impl(key, default_value);
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KeyLike, typename C, typename>
+V SkipList<K, V, Compare, Alloc>::get_or(const KeyLike& key, const V& default_value) {
+    return get_or_impl(key, default_value);
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+bool SkipList<K, V, Compare, Alloc>::contains(const K& key) {
+    return contains_impl(key);
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KeyLike, typename C, typename>
+bool SkipList<K, V, Compare, Alloc>::contains(const KeyLike& key) {
+    return contains_impl(key);
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KeyLike>
+std::optional<V> SkipList<K, V, Compare, Alloc>::find_impl(const KeyLike& key) {
+    StatsLockGuard lock(_mtx, _stats);
+    Node<K, V> *node = find_node(key);
+    if (node == NULL) {
+        return std::nullopt;
+    }
+    return node->get_value();
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KeyLike>
+V SkipList<K, V, Compare, Alloc>::get_or_impl(const KeyLike& key, const V& default_value) {
+    StatsLockGuard lock(_mtx, _stats);
+    Node<K, V> *node = find_node(key);
+    return node != NULL ? node->get_value() : default_value;
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+template<typename KeyLike>
+bool SkipList<K, V, Compare, Alloc>::contains_impl(const KeyLike& key) {
+    StatsLockGuard lock(_mtx, _stats);
+    return find_node(key) != NULL;
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+std::vector<std::optional<V> > SkipList<K, V, Compare, Alloc>::find_batch(const std::vector<K>& keys) {
+
+    std::vector<std::optional<V> > results(keys.size());
+    // 只排序下标，结果仍按输入顺序返回
+    std::vector<size_t> order(keys.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(),
+              [this, &keys](size_t a, size_t b) { return key_less(keys[a], keys[b]); });
+
+    StatsLockGuard lock(_mtx, _stats);
+    // 每次同时推进SKIPLIST_BATCH_INTERLEAVE个查找，每个查找走一步就预取它下一步要读的节点，
+    // 再切换到下一个查找；一个查找等cache miss时其他查找在前进，多个miss重叠进行。
+    // key已排好序，相邻查找的上层路径基本相同，这部分节点一直留在cache里
+    const int group = SKIPLIST_BATCH_INTERLEAVE;
+    for (size_t base = 0; base < order.size(); base += group) {
+        int n = static_cast<int>(std::min<size_t>(group, order.size() - base));
+        Node<K, V> *current[group];
+        Node<K, V> *next[group];
+        int level[group];
+        uint64_t comparisons[group];
+        for (int g = 0; g < n; g++) {
+            current[g] = _header;
+            level[g] = _skip_list_level;
+            next[g] = _header->forward[level[g]];
+            comparisons[g] = 0;
+            SKIPLIST_PREFETCH(next[g]);
+        }
+        int active = n;
+        while (active > 0) {
+            for (int g = 0; g < n; g++) {
+                if (level[g] < 0) {
+                    continue;
+                }
+                const K& key = keys[order[base + g]];
+                if (next[g] != NULL && (++comparisons[g], key_less(next[g]->get_key(), key))) {
+                    current[g] = next[g];//本层继续前进
+                } else if (level[g] > 0) {
+                    level[g]--;//下降一层
+                } else {
+                    // 第0层: next[g]为第一个不小于key的节点
+                    if (next[g] != NULL && key_equal(next[g]->get_key(), key)) {
+                        _stats.hit();
+                        results[order[base + g]] = next[g]->get_value();
+                    } else {
+                        _stats.miss();
+                    }
+                    _stats.descent(_skip_list_level + 1, comparisons[g]);
+                    level[g] = -1;
+                    active--;
+                    continue;
+                }
+                next[g] = current[g]->forward[level[g]];
+                SKIPLIST_PREFETCH(next[g]);
+            }
+        }
+    }
+    return results;
+}
+
 // 跳表的构造函数
-template<typename K, typename V> 
-SkipList<K, V>::SkipList(int max_level) {
+template<typename K, typename V, typename Compare, typename Alloc>
+SkipList<K, V, Compare, Alloc>::SkipList(int max_level, const Compare& compare, const Alloc& allocator)
+    : _compare(compare), _allocator(allocator), _level_gen(max_level), _wal(), _wal_failed(false), _snapshot(NULL), _snapshot_running(false),
+      _snapshot_result(false), _snapshot_compress(false) {
 
     this->_max_level = max_level;
     this->_skip_list_level = 0;
     this->_element_count = 0;
+    this->_version = 0;
 
-    // 创建头节点
-    K k;
-    V v;
-    this->_header = new Node<K, V>(k, v, _max_level);
+    // 创建头节点，key和value都是默认构造的
+    this->_header = new_node(_max_level, K());
+    update_grow_at();
 };
 
 // 跳表的析构函数
-template<typename K, typename V> 
-SkipList<K, V>::~SkipList() {
+template<typename K, typename V, typename Compare, typename Alloc>
+SkipList<K, V, Compare, Alloc>::~SkipList() {
 
+    wait_snapshot();//后台快照还在读节点
+    if (_snapshot_thread.joinable()) {
+        _snapshot_thread.join();
+    }
     if (_file_writer.is_open()) {
         _file_writer.close();
     }
     if (_file_reader.is_open()) {
         _file_reader.close();
     }
-    delete _header;
+    _wal.reset();//关闭前把日志写盘
+    // 沿第0层释放所有节点
+    Node<K, V> *node = _header->forward[0];
+    while (node != NULL) {
+        Node<K, V> *next = node->forward[0];
+        destroy_node(node);
+        node = next;
+    }
+    free_header_forward();
+    destroy_node(_header);
 }
 
-// 生成随机层数
-template<typename K, typename V>
-int SkipList<K, V>::get_random_level(){
+// 生成随机层数，只在锁内调用
+template<typename K, typename V, typename Compare, typename Alloc>
+int SkipList<K, V, Compare, Alloc>::get_random_level(){
+    return _level_gen.next();
+}
 
-    int k = 1;
-    while (rand() % 2) {//没有随机数种子，导致每次生成的数都一样。
-        k++;
-    }
-    k = (k < _max_level) ? k : _max_level;//最高层数限制
-    //std::cout<<rand()<<std::endl;
-    return k;
-};
+template<typename K, typename V, typename Compare, typename Alloc>
+void SkipList<K, V, Compare, Alloc>::set_level_probability(double p) {
+    StatsLockGuard lock(_mtx, _stats);
+    _level_gen.set_probability(p);
+    update_grow_at();
+}
+
+template<typename K, typename V, typename Compare, typename Alloc>
+double SkipList<K, V, Compare, Alloc>::level_probability() {
+    StatsLockGuard lock(_mtx, _stats);
+    return _level_gen.probability();
+}
+
+#endif
 // vim: et tw=100 ts=4 sw=4 cc=120
@@ -0,0 +1,349 @@
+/* ************************************************************************
+> File Name:     skiplist_executor.h
+> Description:   异步执行层: 按key分片，每个分片由一个工作线程独占，
+>                调用者把操作放进该分片的无锁多生产者队列后立即返回，通过future或回调拿结果；
+>                工作线程一次取走队列中的全部操作，按key排序后用手指依次执行
+ ************************************************************************/
+
+#ifndef SKIPLIST_EXECUTOR_H
+#define SKIPLIST_EXECUTOR_H
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <memory>
+#include <exception>
+#include <optional>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "skiplist.h"
+#include "sharded_skiplist.h"
+
+#define EXECUTOR_SORT_BATCH 8       // 一批操作不少于这么多时先按key排序再执行
+#define EXECUTOR_SPIN 256           // 队列为空时先自旋检查这么多次再睡眠
+
+enum ExecutorOpType { EXEC_INSERT, EXEC_DELETE, EXEC_FIND };
+
+// 一个操作的结果
+// insert: code同SkipList::insert_element(1为key已存在)；delete/find: code为1表示key存在，find的value为找到的值。
+// 执行时抛出异常则error非空
+template<typename V>
+struct ExecutorResult {
+    ExecutorResult() : code(0) {}
+
+    int code;
+    std::optional<V> value;
+    std::exception_ptr error;
+};
+
+// 队列中的一个操作，提交时分配，执行完回调后释放
+template<typename K, typename V>
+struct ExecutorOp {
+    ExecutorOp *next;
+    uint64_t seq;//同一分片内的提交顺序，排序时同一key的操作保持这个顺序
+    ExecutorOpType type;
+    K key;
+    V value;
+    std::function<void(const ExecutorResult<V>&)> done;
+};
+
+// 无锁多生产者单消费者队列
+// 生产者用CAS把操作压到链表头；消费者用一次exchange取走整个链表，再反转成提交顺序。
+// 取走的是一整批，正好按批执行。
+template<typename K, typename V>
+class ExecutorQueue {
+public:
+    ExecutorQueue() : _head(NULL) {}
+
+    // 返回压入前队列是否为空
+    bool push(ExecutorOp<K, V> *op) {
+        ExecutorOp<K, V> *head = _head.load(std::memory_order_relaxed);
+        do {
+            op->next = head;
+        } while (!_head.compare_exchange_weak(head, op, std::memory_order_seq_cst, std::memory_order_relaxed));
+        return head == NULL;
+    }
+
+    // 按提交顺序追加到batch末尾，返回取到的个数
+    size_t pop_all(std::vector<ExecutorOp<K, V>*> &batch) {
+        ExecutorOp<K, V> *op = _head.exchange(NULL, std::memory_order_acquire);
+        size_t begin = batch.size();
+        for (; op != NULL; op = op->next) {
+            batch.push_back(op);
+        }
+        std::reverse(batch.begin() + begin, batch.end());
+        return batch.size() - begin;
+    }
+
+    bool empty() const { return _head.load(std::memory_order_seq_cst) == NULL; }
+
+private:
+    std::atomic<ExecutorOp<K, V>*> _head;
+};
+
+// 异步执行层
+// 每个工作线程独占一个SkipList分片和一个队列，分片的锁不会被其他线程竞争，
+// 同一key总是进同一个分片，同一调用者对同一key的操作按提交顺序执行。
+// 回调在工作线程中执行，应尽快返回，不能抛出异常，也不能在回调里同步等待本执行层的结果。
+template <typename K, typename V, typename Partitioner = HashPartitioner<K> >
+class SkipListExecutor {
+
+public:
+    typedef std::function<void(const ExecutorResult<V>&)> Callback;
+
+    // workers为工作线程数(即分片数)，默认为CPU核数
+    explicit SkipListExecutor(int max_level, int workers = 0);
+    SkipListExecutor(int max_level, const Partitioner &partitioner);
+    // 先执行完已提交的操作再退出工作线程
+    ~SkipListExecutor();
+
+    std::future<int> insert_element(K, V);
+    std::future<bool> delete_element(K);
+    std::future<std::optional<V> > find(K);
+
+    // 回调版本，没有future的开销
+    void insert_element(K, V, Callback);
+    void delete_element(K, Callback);
+    void find(K, Callback);
+
+    // 等待调用之前提交的所有操作执行完
+    void flush();
+    size_t size();
+    int worker_count() const;
+
+private:
+    struct Worker {
+        Worker(int max_level)
+            : list(max_level), submitted(0), completed(0), count(0), sleeping(false), stop(false) {}
+
+        SkipList<K, V> list;
+        ExecutorQueue<K, V> queue;
+        std::atomic<uint64_t> submitted;
+        std::atomic<uint64_t> completed;
+        std::atomic<size_t> count;//每批执行完更新的分片元素数，供size()在其他线程读取
+        std::atomic<bool> sleeping;
+        bool stop;
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::thread thread;
+    };
+
+    SkipListExecutor(const SkipListExecutor &);
+    SkipListExecutor &operator=(const SkipListExecutor &);
+
+    void start(int max_level);
+    void submit(ExecutorOpType type, K key, V value, Callback done);
+    void run_worker(Worker *w);
+    void execute(Worker *w, ExecutorOp<K, V> *op, typename SkipList<K, V>::Finger &finger);
+
+private:
+    Partitioner _partitioner;
+    std::vector<Worker*> _workers;
+};
+
+template<typename K, typename V, typename Partitioner>
+SkipListExecutor<K, V, Partitioner>::SkipListExecutor(int max_level, int workers)
+    : _partitioner(workers > 0 ? workers : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()))) {
+    start(max_level);
+}
+
+template<typename K, typename V, typename Partitioner>
+SkipListExecutor<K, V, Partitioner>::SkipListExecutor(int max_level, const Partitioner &partitioner)
+    : _partitioner(partitioner) {
+    start(max_level);
+}
+
+template<typename K, typename V, typename Partitioner>
+void SkipListExecutor<K, V, Partitioner>::start(int max_level) {
+    for (int i = 0; i < _partitioner.shard_count(); i++) {
+        _workers.push_back(new Worker(max_level));
+    }
+    for (size_t i = 0; i < _workers.size(); i++) {
+        _workers[i]->thread = std::thread(&SkipListExecutor<K, V, Partitioner>::run_worker, this, _workers[i]);
+    }
+}
+
+template<typename K, typename V, typename Partitioner>
+SkipListExecutor<K, V, Partitioner>::~SkipListExecutor() {
+    for (size_t i = 0; i < _workers.size(); i++) {
+        Worker *w = _workers[i];
+        {
+            std::lock_guard<std::mutex> lock(w->mtx);
+            w->stop = true;
+        }
+        w->cv.notify_one();
+    }
+    for (size_t i = 0; i < _workers.size(); i++) {
+        _workers[i]->thread.join();
+        delete _workers[i];
+    }
+}
+
+// 入队后只有工作线程可能在睡眠时才加锁唤醒
+// 生产者先入队再读sleeping，工作线程先写sleeping再检查队列，两边都是seq_cst，
+// 不会出现双方都没看到对方的情况
+template<typename K, typename V, typename Partitioner>
+void SkipListExecutor<K, V, Partitioner>::submit(ExecutorOpType type, K key, V value, Callback done) {
+    Worker *w = _workers[_partitioner(key)];
+    ExecutorOp<K, V> *op = new ExecutorOp<K, V>();
+    op->seq = w->submitted.fetch_add(1, std::memory_order_relaxed);
+    op->type = type;
+    op->key = std::move(key);
+    op->value = std::move(value);
+    op->done = std::move(done);
+    w->queue.push(op);
+    if (w->sleeping.load(std::memory_order_seq_cst)) {
+        std::lock_guard<std::mutex> lock(w->mtx);
+        w->cv.notify_one();
+    }
+}
+
+template<typename K, typename V, typename Partitioner>
+void SkipListExecutor<K, V, Partitioner>::run_worker(Worker *w) {
+    std::vector<ExecutorOp<K, V>*> batch;
+    typename SkipList<K, V>::Finger finger;
+    while (true) {
+        batch.clear();
+        for (int spin = 0; spin < EXECUTOR_SPIN && w->queue.pop_all(batch) == 0; spin++) {
+            std::this_thread::yield();
+        }
+        if (batch.empty()) {
+            std::unique_lock<std::mutex> lock(w->mtx);
+            w->sleeping.store(true, std::memory_order_seq_cst);
+            w->cv.wait(lock, [w]() { return w->stop || !w->queue.empty(); });
+            w->sleeping.store(false, std::memory_order_relaxed);
+            if (w->queue.empty()) {
+                return;//stop且已经执行完
+            }
+            continue;
+        }
+
+        // 按key排序后相邻的操作落在跳表的相邻位置，手指从上一个位置附近开始找；
+        // seq作为第二关键字，同一key的操作仍按提交顺序执行
+        if (batch.size() >= EXECUTOR_SORT_BATCH) {
+            std::sort(batch.begin(), batch.end(), [](const ExecutorOp<K, V> *a, const ExecutorOp<K, V> *b) {
+                return a->key < b->key || (!(b->key < a->key) && a->seq < b->seq);
+            });
+        }
+        for (size_t i = 0; i < batch.size(); i++) {
+            execute(w, batch[i], finger);
+        }
+        w->count.store(w->list.size(), std::memory_order_relaxed);
+        w->completed.fetch_add(batch.size(), std::memory_order_release);
+    }
+}
+
+template<typename K, typename V, typename Partitioner>
+void SkipListExecutor<K, V, Partitioner>::execute(Worker *w, ExecutorOp<K, V> *op,
+                                                  typename SkipList<K, V>::Finger &finger) {
+    ExecutorResult<V> result;
+    try {
+        switch (op->type) {
+        case EXEC_INSERT:
+            result.code = w->list.insert_element(op->key, std::move(op->value), finger);
+            break;
+        case EXEC_DELETE:
+            result.code = w->list.delete_element(op->key, finger) ? 1 : 0;
+            break;
+        default:
+            result.value = w->list.find(op->key);
+            result.code = result.value ? 1 : 0;
+            break;
+        }
+    } catch (...) {
+        result.error = std::current_exception();
+    }
+    if (op->done) {
+        op->done(result);
+    }
+    delete op;
+}
+
+template<typename K, typename V, typename Partitioner>
+std::future<int> SkipListExecutor<K, V, Partitioner>::insert_element(K key, V value) {
+    std::shared_ptr<std::promise<int> > promise(new std::promise<int>());
+    std::future<int> future = promise->get_future();
+    submit(EXEC_INSERT, std::move(key), std::move(value), [promise](const ExecutorResult<V> &r) {
+        if (r.error) {
+            promise->set_exception(r.error);
+        } else {
+            promise->set_value(r.code);
+        }
+    });
+    return future;
+}
+
+template<typename K, typename V, typename Partitioner>
+std::future<bool> SkipListExecutor<K, V, Partitioner>::delete_element(K key) {
+    std::shared_ptr<std::promise<bool> > promise(new std::promise<bool>());
+    std::future<bool> future = promise->get_future();
+    submit(EXEC_DELETE, std::move(key), V(), [promise](const ExecutorResult<V> &r) {
+        if (r.error) {
+            promise->set_exception(r.error);
+        } else {
+            promise->set_value(r.code != 0);
+        }
+    });
+    return future;
+}
+
+template<typename K, typename V, typename Partitioner>
+std::future<std::optional<V> > SkipListExecutor<K, V, Partitioner>::find(K key) {
+    std::shared_ptr<std::promise<std::optional<V> > > promise(new std::promise<std::optional<V> >());
+    std::future<std::optional<V> > future = promise->get_future();
+    submit(EXEC_FIND, std::move(key), V(), [promise](const ExecutorResult<V> &r) {
+        if (r.error) {
+            promise->set_exception(r.error);
+        } else {
+            promise->set_value(r.value);
+        }
+    });
+    return future;
+}
+
+template<typename K, typename V, typename Partitioner>
+void SkipListExecutor<K, V, Partitioner>::insert_element(K key, V value, Callback done) {
+    submit(EXEC_INSERT, std::move(key), std::move(value), std::move(done));
+}
+
+template<typename K, typename V, typename Partitioner>
+void SkipListExecutor<K, V, Partitioner>::delete_element(K key, Callback done) {
+    submit(EXEC_DELETE, std::move(key), V(), std::move(done));
+}
+
+template<typename K, typename V, typename Partitioner>
+void SkipListExecutor<K, V, Partitioner>::find(K key, Callback done) {
+    submit(EXEC_FIND, std::move(key), V(), std::move(done));
+}
+
+template<typename K, typename V, typename Partitioner>
+void SkipListExecutor<K, V, Partitioner>::flush() {
+    for (size_t i = 0; i < _workers.size(); i++) {
+        Worker *w = _workers[i];
+        uint64_t target = w->submitted.load(std::memory_order_relaxed);
+        while (w->completed.load(std::memory_order_acquire) < target) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// 各分片元素数之和，只包含已执行完的批次
+template<typename K, typename V, typename Partitioner>
+size_t SkipListExecutor<K, V, Partitioner>::size() {
+    size_t total = 0;
+    for (size_t i = 0; i < _workers.size(); i++) {
+        total += _workers[i]->count.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+template<typename K, typename V, typename Partitioner>
+int SkipListExecutor<K, V, Partitioner>::worker_count() const {
+    return static_cast<int>(_workers.size());
+}
+
+#endif
+// vim: et tw=100 ts=4 sw=4 cc=120
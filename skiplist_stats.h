@@ -0,0 +1,248 @@
+/* ************************************************************************
+> File Name:     skiplist_stats.h
+> Description:   跳表的运行统计: 命中/未命中/插入/更新/删除计数，每次查找经过的层数和比较次数，
+>                以及等锁时间的直方图。编译时定义SKIPLIST_STATS才启用，
+>                否则所有记录函数都是空的内联函数，不产生任何代码
+ ************************************************************************/
+
+#ifndef SKIPLIST_STATS_H
+#define SKIPLIST_STATS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <mutex>
+#ifdef SKIPLIST_STATS
+#include <atomic>
+#include <chrono>
+#endif
+
+#define STATS_HISTOGRAM_BUCKETS 40
+
+// 以2的幂分桶的直方图: 第0个桶为0，第i个桶为[2^(i-1), 2^i)
+struct StatsHistogram {
+    StatsHistogram() : count(0), sum(0), max(0) {
+        for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+            buckets[i] = 0;
+        }
+    }
+
+    static int bucket_of(uint64_t value) {
+        int b = value == 0 ? 0 : 64 - __builtin_clzll(value);
+        return b < STATS_HISTOGRAM_BUCKETS ? b : STATS_HISTOGRAM_BUCKETS - 1;
+    }
+
+    double mean() const { return count == 0 ? 0 : static_cast<double>(sum) / count; }
+
+    // 第p百分位所在桶的上界(p取0~100)，不超过max
+    uint64_t percentile(double p) const {
+        uint64_t target = static_cast<uint64_t>(count * p / 100);
+        uint64_t seen = 0;
+        for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+            seen += buckets[i];
+            if (seen > target) {
+                uint64_t upper = i == 0 ? 0 : (1ULL << i) - 1;
+                return upper < max ? upper : max;
+            }
+        }
+        return max;
+    }
+
+    StatsHistogram& operator+=(const StatsHistogram& other) {
+        count += other.count;
+        sum += other.sum;
+        max = max > other.max ? max : other.max;
+        for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+            buckets[i] += other.buckets[i];
+        }
+        return *this;
+    }
+
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[STATS_HISTOGRAM_BUCKETS];
+};
+
+// 某一时刻的统计快照，未启用统计时全为0
+struct SkipListStats {
+    SkipListStats() : hits(0), misses(0), inserts(0), updates(0), deletes(0) {}
+
+    SkipListStats& operator+=(const SkipListStats& other) {
+        hits += other.hits;
+        misses += other.misses;
+        inserts += other.inserts;
+        updates += other.updates;
+        deletes += other.deletes;
+        levels += other.levels;
+        comparisons += other.comparisons;
+        lock_wait_ns += other.lock_wait_ns;
+        return *this;
+    }
+
+    // 文本格式，每项一行
+    std::string to_string() const;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t inserts;
+    uint64_t updates;
+    uint64_t deletes;
+    StatsHistogram levels;//每次查找从第几层开始下降(经过的层数)
+    StatsHistogram comparisons;//每次查找的key比较次数
+    StatsHistogram lock_wait_ns;//每次加锁的等待时间(纳秒)
+};
+
+inline std::string SkipListStats::to_string() const {
+    std::string out;
+    char line[256];
+    snprintf(line, sizeof(line), "hits: %llu\nmisses: %llu\ninserts: %llu\nupdates: %llu\ndeletes: %llu\n",
+             (unsigned long long)hits, (unsigned long long)misses, (unsigned long long)inserts,
+             (unsigned long long)updates, (unsigned long long)deletes);
+    out += line;
+    const char *names[] = {"levels", "comparisons", "lock_wait_ns"};
+    const StatsHistogram *hists[] = {&levels, &comparisons, &lock_wait_ns};
+    for (int i = 0; i < 3; i++) {
+        snprintf(line, sizeof(line), "%s: count=%llu mean=%.1f p50=%llu p99=%llu max=%llu\n", names[i],
+                 (unsigned long long)hists[i]->count, hists[i]->mean(),
+                 (unsigned long long)hists[i]->percentile(50), (unsigned long long)hists[i]->percentile(99),
+                 (unsigned long long)hists[i]->max);
+        out += line;
+    }
+    return out;
+}
+
+#ifdef SKIPLIST_STATS
+
+// 并发记录用的直方图，各字段独立原子累加(relaxed)，读出的快照不保证各字段严格一致
+class AtomicHistogram {
+public:
+    AtomicHistogram() { reset(); }
+
+    void record(uint64_t value) {
+        _count.fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(value, std::memory_order_relaxed);
+        _buckets[StatsHistogram::bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+        uint64_t old = _max.load(std::memory_order_relaxed);
+        while (value > old && !_max.compare_exchange_weak(old, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    void load(StatsHistogram& out) const {
+        out.count = _count.load(std::memory_order_relaxed);
+        out.sum = _sum.load(std::memory_order_relaxed);
+        out.max = _max.load(std::memory_order_relaxed);
+        for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+            out.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    void reset() {
+        _count.store(0, std::memory_order_relaxed);
+        _sum.store(0, std::memory_order_relaxed);
+        _max.store(0, std::memory_order_relaxed);
+        for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+            _buckets[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    std::atomic<uint64_t> _count;
+    std::atomic<uint64_t> _sum;
+    std::atomic<uint64_t> _max;
+    std::atomic<uint64_t> _buckets[STATS_HISTOGRAM_BUCKETS];
+};
+
+// 跳表内部的统计记录器
+class StatsRecorder {
+public:
+    StatsRecorder() { reset(); }
+
+    void hit() { _hits.fetch_add(1, std::memory_order_relaxed); }
+    void miss() { _misses.fetch_add(1, std::memory_order_relaxed); }
+    void insert() { _inserts.fetch_add(1, std::memory_order_relaxed); }
+    void update() { _updates.fetch_add(1, std::memory_order_relaxed); }
+    void erase() { _deletes.fetch_add(1, std::memory_order_relaxed); }
+    // 一次自顶向下的查找: 经过的层数和比较次数
+    void descent(int levels, uint64_t comparisons) {
+        _levels.record(static_cast<uint64_t>(levels));
+        _comparisons.record(comparisons);
+    }
+
+    // 加锁: 先try_lock，拿不到才计时等待，不竞争时只多一次try_lock
+    void lock(std::mutex& mtx) {
+        if (mtx.try_lock()) {
+            _lock_wait_ns.record(0);
+            return;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        mtx.lock();
+        _lock_wait_ns.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+
+    SkipListStats snapshot() const {
+        SkipListStats s;
+        s.hits = _hits.load(std::memory_order_relaxed);
+        s.misses = _misses.load(std::memory_order_relaxed);
+        s.inserts = _inserts.load(std::memory_order_relaxed);
+        s.updates = _updates.load(std::memory_order_relaxed);
+        s.deletes = _deletes.load(std::memory_order_relaxed);
+        _levels.load(s.levels);
+        _comparisons.load(s.comparisons);
+        _lock_wait_ns.load(s.lock_wait_ns);
+        return s;
+    }
+
+    void reset() {
+        _hits.store(0, std::memory_order_relaxed);
+        _misses.store(0, std::memory_order_relaxed);
+        _inserts.store(0, std::memory_order_relaxed);
+        _updates.store(0, std::memory_order_relaxed);
+        _deletes.store(0, std::memory_order_relaxed);
+        _levels.reset();
+        _comparisons.reset();
+        _lock_wait_ns.reset();
+    }
+
+private:
+    std::atomic<uint64_t> _hits;
+    std::atomic<uint64_t> _misses;
+    std::atomic<uint64_t> _inserts;
+    std::atomic<uint64_t> _updates;
+    std::atomic<uint64_t> _deletes;
+    AtomicHistogram _levels;
+    AtomicHistogram _comparisons;
+    AtomicHistogram _lock_wait_ns;
+};
+
+#else
+
+// 未启用统计: 全部为空函数，调用处连同参数计算一起被优化掉
+class StatsRecorder {
+public:
+    void hit() {}
+    void miss() {}
+    void insert() {}
+    void update() {}
+    void erase() {}
+    void descent(int, uint64_t) {}
+    void lock(std::mutex& mtx) { mtx.lock(); }
+    SkipListStats snapshot() const { return SkipListStats(); }
+    void reset() {}
+};
+
+#endif
+
+// 与std::lock_guard相同，加锁时记录等锁时间
+class StatsLockGuard {
+public:
+    StatsLockGuard(std::mutex& mtx, StatsRecorder& stats) : _mtx(mtx) { stats.lock(mtx); }
+    ~StatsLockGuard() { _mtx.unlock(); }
+private:
+    StatsLockGuard(const StatsLockGuard &);
+    StatsLockGuard &operator=(const StatsLockGuard &);
+    std::mutex &_mtx;
+};
+
+#endif
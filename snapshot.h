@@ -0,0 +1,386 @@
+/* ************************************************************************
+> File Name:     snapshot.h
+> Description:   跳表的二进制快照
+>                文件格式: [文件头][块]...[结束块]
+>                文件头: 8字节magic + 4字节版本 + 4字节标志 + 8字节总记录数
+>                块:     4字节payload长度 + 4字节记录数 + 4字节payload的CRC32C + payload
+>                payload由若干(key, value)记录组成，编码见serialize.h；结束块的长度和记录数都为0
+>                版本2: 标志SNAPSHOT_FLAG_LZ表示块经过压缩，payload为 4字节原始长度 + 1字节方法 + 数据，
+>                       方法0为原样存放(压缩后没有变小)，1为LZ(见serialize.h)；CRC校验的是存放的payload。
+>                       不压缩时写出的文件与版本1相同，版本1的文件仍可读取
+ ************************************************************************/
+
+#ifndef SKIPLIST_SNAPSHOT_H
+#define SKIPLIST_SNAPSHOT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <map>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "serialize.h"
+
+#define SNAPSHOT_FILE "store/snapshot"
+#define SNAPSHOT_MAGIC "SKIPLIST"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_FLAG_LZ 1
+#define SNAPSHOT_HEADER_SIZE 24
+#define SNAPSHOT_BLOCK_HEADER_SIZE 12
+#define SNAPSHOT_BLOCK_SIZE (1 << 20)   // 每攒够1MB的记录写一个块
+#define SNAPSHOT_SCAN_BATCH 256         // 后台快照每次加锁读取的记录数
+
+// 快照写入
+// 先写到path.tmp，finish()时fsync并rename，中途失败不会破坏已有的快照。
+template<typename K, typename V>
+class SnapshotWriter {
+
+public:
+    SnapshotWriter() : _fd(-1), _compress(false), _block_entries(0), _count(0) {}
+    ~SnapshotWriter();
+
+    // compress为true时每个块用LZ压缩，适合value短而重复的数据
+    bool open(const std::string &path, bool compress = false);
+    bool append(const K &key, const V &value);
+    bool finish();
+
+    uint64_t count() const { return _count; }
+
+private:
+    bool flush_block();
+
+private:
+    int _fd;
+    bool _compress;
+    std::string _path;
+    std::string _tmp_path;
+    std::string _block;//当前块的payload
+    std::string _compressed;//压缩后的payload
+    uint32_t _block_entries;
+    uint64_t _count;
+};
+
+template<typename K, typename V>
+SnapshotWriter<K, V>::~SnapshotWriter() {
+    if (_fd >= 0) {
+        close(_fd);
+        unlink(_tmp_path.c_str());//没有finish，丢弃临时文件
+    }
+}
+
+template<typename K, typename V>
+bool SnapshotWriter<K, V>::open(const std::string &path, bool compress) {
+    _path = path;
+    _compress = compress;
+    _tmp_path = path + ".tmp";
+    _fd = ::open(_tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (_fd < 0) {
+        return false;
+    }
+    // 文件头中的记录数在finish时回填
+    std::string header(SNAPSHOT_MAGIC, 8);
+    put_fixed<uint32_t>(header, compress ? SNAPSHOT_VERSION : 1);
+    put_fixed<uint32_t>(header, compress ? SNAPSHOT_FLAG_LZ : 0);
+    put_fixed<uint64_t>(header, 0);
+    struct iovec iov = {const_cast<char*>(header.data()), header.size()};
+    _block.reserve(SNAPSHOT_BLOCK_SIZE + 4096);
+    return write_fully(_fd, &iov, 1);
+}
+
+template<typename K, typename V>
+bool SnapshotWriter<K, V>::append(const K &key, const V &value) {
+    Codec<K>::encode(_block, key);
+    Codec<V>::encode(_block, value);
+    _block_entries++;
+    _count++;
+    if (_block.size() >= SNAPSHOT_BLOCK_SIZE) {
+        return flush_block();
+    }
+    return true;
+}
+
+// 块头和payload用一次writev写出，payload不需要再拷贝到一起
+template<typename K, typename V>
+bool SnapshotWriter<K, V>::flush_block() {
+    const std::string *payload = &_block;
+    if (_compress && !_block.empty()) {
+        _compressed.clear();
+        put_fixed<uint32_t>(_compressed, static_cast<uint32_t>(_block.size()));
+        _compressed.push_back(1);
+        lz_compress(_block.data(), _block.size(), _compressed);
+        if (_compressed.size() >= _block.size() + 5) {
+            _compressed.resize(4);
+            _compressed.push_back(0);
+            _compressed.append(_block);
+        }
+        payload = &_compressed;
+    }
+    std::string header;
+    put_fixed<uint32_t>(header, static_cast<uint32_t>(payload->size()));
+    put_fixed<uint32_t>(header, _block_entries);
+    put_fixed<uint32_t>(header, payload->empty() ? 0 : crc32c(payload->data(), payload->size()));
+    struct iovec iov[2] = {
+        {const_cast<char*>(header.data()), header.size()},
+        {const_cast<char*>(payload->data()), payload->size()}
+    };
+    bool ok = write_fully(_fd, iov, payload->empty() ? 1 : 2);
+    _block.clear();
+    _block_entries = 0;
+    return ok;
+}
+
+template<typename K, typename V>
+bool SnapshotWriter<K, V>::finish() {
+    if (_fd < 0) {
+        return false;
+    }
+    bool ok = true;
+    if (!_block.empty()) {
+        ok = flush_block();
+    }
+    ok = ok && flush_block();//结束块
+
+    std::string count;
+    put_fixed<uint64_t>(count, _count);
+    ok = ok && pwrite(_fd, count.data(), count.size(), 16) == static_cast<ssize_t>(count.size());
+    ok = ok && fsync(_fd) == 0;
+    close(_fd);
+    _fd = -1;
+    if (!ok || rename(_tmp_path.c_str(), _path.c_str()) != 0) {
+        unlink(_tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// 后台快照期间写者看到的接口
+// 后台快照按key升序分批读取跳表，cursor之前的key已经读过。写者修改一个还没读到的key之前，
+// 先把它修改前的状态交给preserve保存，快照线程读到这个key时用保存的旧状态代替当前状态，
+// 写出的就是开始快照那一刻的数据。value为NULL表示修改前key不存在(本次是插入)。
+template<typename K, typename V>
+class SnapshotCapture {
+public:
+    virtual ~SnapshotCapture() {}
+    virtual void preserve(const K& key, const V* value) = 0;
+};
+
+// 后台快照的状态，所有成员都只在跳表的锁内访问
+// undo中只保存cursor之后、快照开始后第一次被修改的key，快照线程每读完一批就丢掉cursor之前的部分。
+template<typename K, typename V, typename Compare>
+class SnapshotView : public SnapshotCapture<K, V> {
+
+public:
+    explicit SnapshotView(const Compare& compare) : has_cursor(false), undo(compare), _compare(compare) {}
+
+    void preserve(const K& key, const V* value) {
+        if (has_cursor && !_compare(cursor, key)) {
+            return;//已经写进快照
+        }
+        if (undo.find(key) == undo.end()) {
+            undo.insert(std::make_pair(key, value != NULL ? std::make_pair(true, *value) : std::make_pair(false, V())));
+        }
+    }
+
+    K cursor;//最后读到的key
+    bool has_cursor;
+    std::map<K, std::pair<bool, V>, Compare> undo;//key -> (修改前是否存在, 修改前的value)
+
+private:
+    Compare _compare;
+};
+
+// 读取时记录的形式: 字符串是指向映射内存(压缩的块指向解压缓冲)的string_view，不拷贝；
+// 其它类型解码成值。自定义类型可以特化
+template<typename T>
+struct SnapshotField {
+    typedef T type;
+    static bool decode(const char *&p, const char *end, T &value) { return Codec<T>::decode(p, end, value); }
+};
+
+template<>
+struct SnapshotField<std::string> {
+    typedef std::string_view type;
+    static bool decode(const char *&p, const char *end, std::string_view &value) {
+        return Codec<std::string>::decode_view(p, end, value);
+    }
+};
+
+// read_block的返回值
+enum SnapshotBlockStatus {
+    SNAPSHOT_BLOCK_OK,      // 读完一个块
+    SNAPSHOT_BLOCK_END,     // 到达结束块，且读过的记录数与文件头一致
+    SNAPSHOT_BLOCK_ERROR    // 块越界、解压失败、记录解码失败或记录数不符
+};
+
+// 快照读取
+// 整个文件mmap进来，按块校验后直接从映射的内存中解码，不经过额外的读缓冲。
+template<typename K, typename V>
+class SnapshotReader {
+
+public:
+    typedef typename SnapshotField<K>::type KeyView;
+    typedef typename SnapshotField<V>::type ValueView;
+
+    SnapshotReader() : _data(NULL), _size(0), _pos(0), _count(0), _read(0), _flags(0) {}
+    ~SnapshotReader();
+
+    // 映射文件并检查文件头
+    bool open(const std::string &path);
+    // 检查所有块的CRC，再把所有记录解码一遍(不拷贝字符串)，全部正确才返回true。
+    // 通过后read_block从头读起，不会再失败
+    bool verify();
+    // 对下一个块的每条记录调用fn(const KeyView&, const ValueView&)，view只在本次调用内有效
+    template<typename Fn>
+    SnapshotBlockStatus read_block(Fn fn);
+
+    uint64_t count() const { return _count; }
+
+private:
+    // 读取pos处的块头，返回payload位置；结束块或越界时返回false
+    bool block_at(size_t pos, uint32_t &len, uint32_t &entries, uint32_t &crc) const;
+
+private:
+    const char *_data;
+    size_t _size;
+    size_t _pos;
+    uint64_t _count;
+    uint64_t _read;//已读过的记录数
+    uint32_t _flags;
+    std::vector<char> _raw;//解压后的payload
+};
+
+template<typename K, typename V>
+SnapshotReader<K, V>::~SnapshotReader() {
+    if (_data != NULL) {
+        munmap(const_cast<char*>(_data), _size);
+    }
+}
+
+template<typename K, typename V>
+bool SnapshotReader<K, V>::open(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < SNAPSHOT_HEADER_SIZE) {
+        close(fd);
+        return false;
+    }
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    _data = static_cast<const char*>(addr);
+    _size = st.st_size;
+    madvise(addr, _size, MADV_SEQUENTIAL);
+
+    const char *p = _data + 8;
+    uint32_t version;
+    if (memcmp(_data, SNAPSHOT_MAGIC, 8) != 0 ||
+        !get_fixed(p, _data + _size, version) || version < 1 || version > SNAPSHOT_VERSION ||
+        !get_fixed(p, _data + _size, _flags) || !get_fixed(p, _data + _size, _count) ||
+        (version == 1 && _flags != 0) || (_flags & ~static_cast<uint32_t>(SNAPSHOT_FLAG_LZ)) != 0) {
+        return false;
+    }
+    _pos = SNAPSHOT_HEADER_SIZE;
+    return true;
+}
+
+template<typename K, typename V>
+bool SnapshotReader<K, V>::block_at(size_t pos, uint32_t &len, uint32_t &entries, uint32_t &crc) const {
+    if (_size - pos < SNAPSHOT_BLOCK_HEADER_SIZE) {
+        return false;
+    }
+    const char *p = _data + pos;
+    if (!get_fixed(p, _data + _size, len) || !get_fixed(p, _data + _size, entries) ||
+        !get_fixed(p, _data + _size, crc)) {
+        return false;
+    }
+    return len > 0 && _size - pos - SNAPSHOT_BLOCK_HEADER_SIZE >= len;
+}
+
+template<typename K, typename V>
+bool SnapshotReader<K, V>::verify() {
+    if (_data == NULL) {
+        return false;
+    }
+    size_t pos = SNAPSHOT_HEADER_SIZE;
+    uint64_t total = 0;
+    uint32_t len, entries, crc;
+    while (block_at(pos, len, entries, crc)) {
+        if (crc32c(_data + pos + SNAPSHOT_BLOCK_HEADER_SIZE, len) != crc) {
+            return false;
+        }
+        total += entries;
+        pos += SNAPSHOT_BLOCK_HEADER_SIZE + len;
+    }
+    // 必须以结束块收尾，且记录数与文件头一致，否则说明文件被截断
+    const char *p = _data + pos;
+    if (_size - pos < SNAPSHOT_BLOCK_HEADER_SIZE || !get_fixed(p, _data + _size, len) || len != 0 ||
+        total != _count) {
+        return false;
+    }
+    // CRC只能发现写坏的数据，解压失败或记录格式不对(如写出时就有问题)要解码才知道
+    SnapshotBlockStatus status;
+    while ((status = read_block([](const KeyView &, const ValueView &) {})) == SNAPSHOT_BLOCK_OK) {
+    }
+    _pos = SNAPSHOT_HEADER_SIZE;
+    _read = 0;
+    return status == SNAPSHOT_BLOCK_END;
+}
+
+template<typename K, typename V>
+template<typename Fn>
+SnapshotBlockStatus SnapshotReader<K, V>::read_block(Fn fn) {
+    uint32_t len, entries, crc;
+    if (_data == NULL) {
+        return SNAPSHOT_BLOCK_ERROR;
+    }
+    if (!block_at(_pos, len, entries, crc)) {
+        const char *p = _data + _pos;
+        bool end_block = _size - _pos >= SNAPSHOT_BLOCK_HEADER_SIZE && get_fixed(p, _data + _size, len) && len == 0;
+        return end_block && _read == _count ? SNAPSHOT_BLOCK_END : SNAPSHOT_BLOCK_ERROR;
+    }
+    const char *p = _data + _pos + SNAPSHOT_BLOCK_HEADER_SIZE;
+    const char *end = p + len;
+    if (_flags & SNAPSHOT_FLAG_LZ) {
+        uint32_t raw_len;
+        if (!get_fixed(p, end, raw_len) || p == end) {
+            return SNAPSHOT_BLOCK_ERROR;
+        }
+        char method = *p++;
+        if (method == 1) {
+            _raw.resize(raw_len);
+            if (!lz_decompress(p, end - p, _raw.data(), raw_len)) {
+                return SNAPSHOT_BLOCK_ERROR;
+            }
+            p = _raw.data();
+            end = p + raw_len;
+        } else if (method != 0 || static_cast<size_t>(end - p) != raw_len) {
+            return SNAPSHOT_BLOCK_ERROR;
+        }
+    }
+    KeyView key;
+    ValueView value;
+    for (uint32_t i = 0; i < entries; i++) {
+        if (!SnapshotField<K>::decode(p, end, key) || !SnapshotField<V>::decode(p, end, value)) {
+            return SNAPSHOT_BLOCK_ERROR;
+        }
+        fn(key, value);
+    }
+    // 块内的记录必须恰好用完payload
+    if (p != end) {
+        return SNAPSHOT_BLOCK_ERROR;
+    }
+    _read += entries;
+    _pos += SNAPSHOT_BLOCK_HEADER_SIZE + len;
+    return SNAPSHOT_BLOCK_OK;
+}
+
+#endif
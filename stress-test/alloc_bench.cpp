@@ -0,0 +1,74 @@
+/* ************************************************************************
+> File Name:     alloc_bench.cpp
+> Description:   对比不同节点分配策略的插入速度和内存占用
+>                每种策略在独立的子进程中运行，RSS互不影响
+>                用法: ./bin/alloc_bench [key数量]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "bench_util.h"
+#include "../skiplist.h"
+
+#define MAX_LEVEL 24
+
+// 乘以奇数在模2^32下是双射，得到互不相同且顺序打乱的key
+inline int nth_key(long i) {
+    return static_cast<int>(static_cast<uint32_t>(i) * 2654435761u);
+}
+
+template<typename Alloc>
+void run(const char *name, long count) {
+
+    long base_rss = bench::rss_kb();
+    SkipList<int, std::string, std::less<int>, Alloc> list(MAX_LEVEL);
+
+    double start = bench::now_seconds();
+    for (long i = 0; i < count; i++) {
+        list.insert_element(nth_key(i), "a");
+    }
+    double insert_elapsed = bench::now_seconds() - start;
+    long insert_rss = bench::rss_kb() - base_rss;
+
+    // 删掉一半再插回去，观察释放的节点能否被复用
+    start = bench::now_seconds();
+    for (long i = 0; i < count; i += 2) {
+        list.delete_element(nth_key(i));
+    }
+    for (long i = 0; i < count; i += 2) {
+        list.insert_element(nth_key(i), "a");
+    }
+    double churn_elapsed = bench::now_seconds() - start;
+    long churn_rss = bench::rss_kb() - base_rss;
+
+    printf("%-8s %14.0f %14.0f %12.1f %12.1f %10.1f\n", name,
+           count / insert_elapsed, count / churn_elapsed,
+           insert_rss / 1024.0, churn_rss / 1024.0, insert_rss * 1024.0 / count);
+}
+
+// 在子进程里跑，避免前一种策略留下的堆影响RSS
+template<typename Alloc>
+void run_isolated(const char *name, long count) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        run<Alloc>(name, count);
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+}
+
+int main(int argc, char **argv) {
+
+    long count = bench::arg_or(argc, argv, 1, 10000000);
+
+    printf("keys: %ld\n", count);
+    printf("%-8s %14s %14s %12s %12s %10s\n", "alloc", "insert/s", "churn op/s", "RSS(MB)", "churn RSS", "B/key");
+    run_isolated<HeapNodeAllocator>("heap", count);
+    run_isolated<ArenaNodeAllocator>("arena", count);
+    return 0;
+}
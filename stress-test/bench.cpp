@@ -0,0 +1,231 @@
+/* ************************************************************************
+> File Name:     bench.cpp
+> Description:   可配置的综合benchmark: 同一份负载依次跑各种跳表实现，输出吞吐和p50/p99/p999延迟
+>                用法: ./bin/bench [--name=value ...]
+>                  --mode=all|skiplist|arena|sharded|rcu|lockfree  跑哪种实现(all为全部，skiplist为基准)
+>                  --threads=4         线程数
+>                  --ops=1000000       计时阶段的总操作数
+>                  --keys=100000       key的取值范围，计时前先插入其中一半
+>                  --dist=uniform|zipfian|sequential  key分布
+>                  --theta=0.99        zipfian的集中程度，取(0, 1)
+>                  --read=90           读操作的百分比
+>                  --delete=5          删除操作的百分比，其余为写入(插入或更新)
+>                  --key-size=16       key的字节数(十进制数字，左边补0)
+>                  --value-size=100    value的字节数
+>                  --shards=16         sharded模式的分片数
+>                  --seed=1            随机数种子，相同参数和种子得到相同的操作序列
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <cstdlib>
+#include <vector>
+#include "bench_util.h"
+#include "../skiplist.h"
+#include "../sharded_skiplist.h"
+#include "../rcu_skiplist.h"
+#include "../lockfree_skiplist.h"
+
+#define MAX_LEVEL 18
+
+enum OpType { OP_READ = 0, OP_WRITE = 1, OP_DELETE = 2, OP_TYPES = 3 };
+
+// 一次运行的参数
+struct Workload {
+    std::string mode;
+    int threads;
+    long ops;
+    long keys;
+    std::string dist;
+    double theta;
+    int read_pct;
+    int delete_pct;
+    int key_size;
+    int value_size;
+    int shards;
+    long seed;
+};
+
+// 第i个key: 定长的十进制字符串，数值顺序与字符串顺序一致
+static std::string make_key(uint64_t i, int key_size) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%020llu", static_cast<unsigned long long>(i));
+    std::string digits(buf);
+    if (key_size <= 20) {
+        return digits.substr(20 - key_size);
+    }
+    return std::string(key_size - 20, '0') + digits;
+}
+
+// 每个线程的key序列
+class KeyStream {
+public:
+    KeyStream(const Workload &w, const bench::Zipfian &zipf, int tid)
+        : _w(w), _zipf(zipf), _rng(w.seed * 1000 + tid + 1),
+          _next(static_cast<uint64_t>(w.keys) / w.threads * tid) {}
+
+    uint64_t next() {
+        if (_w.dist == "zipfian") {
+            return _zipf.next(_rng);
+        }
+        if (_w.dist == "sequential") {
+            return _next++ % static_cast<uint64_t>(_w.keys);//各线程从不同位置开始顺序前进
+        }
+        return _rng.next(_w.keys);
+    }
+
+    // 操作类型，按read_pct/delete_pct抽取
+    OpType next_op() {
+        int r = static_cast<int>(_rng.next(100));
+        if (r < _w.read_pct) {
+            return OP_READ;
+        }
+        return r < _w.read_pct + _w.delete_pct ? OP_DELETE : OP_WRITE;
+    }
+
+private:
+    const Workload &_w;
+    const bench::Zipfian &_zipf;
+    bench::Rng _rng;
+    uint64_t _next;
+};
+
+// 预先生成所有线程的操作序列，计时阶段不再格式化字符串，也保证每种实现执行完全相同的操作
+struct Op {
+    OpType type;
+    std::string key;
+};
+
+static std::vector<std::vector<Op> > make_ops(const Workload &w) {
+    bench::Zipfian zipf(w.dist == "zipfian" ? w.keys : 2, w.theta);
+    std::vector<std::vector<Op> > ops(w.threads);
+    long per_thread = w.ops / w.threads;
+    for (int t = 0; t < w.threads; t++) {
+        KeyStream stream(w, zipf, t);
+        ops[t].reserve(per_thread);
+        for (long i = 0; i < per_thread; i++) {
+            Op op;
+            op.type = stream.next_op();
+            op.key = make_key(stream.next(), w.key_size);
+            ops[t].push_back(op);
+        }
+    }
+    return ops;
+}
+
+template<typename List>
+static void run_list(const char *name, List &list, const Workload &w, const std::vector<std::vector<Op> > &ops) {
+    std::string value(w.value_size, 'v');
+    for (long i = 0; i < w.keys; i += 2) {
+        list.insert_element(make_key(i, w.key_size), value);
+    }
+
+    std::vector<long> hits(w.threads);
+    std::vector<std::vector<bench::LatencyHistogram> > hists(w.threads,
+                                                             std::vector<bench::LatencyHistogram>(OP_TYPES));
+    double elapsed = bench::run_threads(w.threads, [&](int tid) {
+        const std::vector<Op> &mine = ops[tid];
+        std::vector<bench::LatencyHistogram> &hist = hists[tid];
+        long found = 0;
+        for (size_t i = 0; i < mine.size(); i++) {
+            uint64_t start = bench::now_nanos();
+            switch (mine[i].type) {
+            case OP_READ:
+                found += list.search_element(mine[i].key);//使用结果，否则整个查找可能被优化掉
+                break;
+            case OP_WRITE:
+                list.insert_element(mine[i].key, value);
+                break;
+            default:
+                list.delete_element(mine[i].key);
+                break;
+            }
+            hist[mine[i].type].record(bench::now_nanos() - start);
+        }
+        hits[tid] = found;
+    });
+
+    bench::LatencyHistogram merged[OP_TYPES];
+    bench::LatencyHistogram all;
+    uint64_t total = 0;
+    long found = 0;
+    for (int t = 0; t < w.threads; t++) {
+        found += hits[t];
+        for (int k = 0; k < OP_TYPES; k++) {
+            merged[k].merge(hists[t][k]);
+            all.merge(hists[t][k]);
+        }
+        total += ops[t].size();
+    }
+    printf("%-10s %12.0f %8llu %8llu %8llu", name, total / elapsed, (unsigned long long)all.percentile(50),
+           (unsigned long long)all.percentile(99), (unsigned long long)all.percentile(99.9));
+    const OpType types[] = {OP_READ, OP_WRITE};
+    for (int k = 0; k < 2; k++) {
+        const bench::LatencyHistogram &h = merged[types[k]];
+        if (h.count() == 0) {
+            printf(" %8s %8s", "-", "-");
+        } else {
+            printf(" %8llu %8llu", (unsigned long long)h.percentile(50), (unsigned long long)h.percentile(99));
+        }
+    }
+    printf(" %7.1f%%\n", merged[OP_READ].count() == 0 ? 0 : 100.0 * found / merged[OP_READ].count());
+    fflush(stdout);
+}
+
+static bool selected(const Workload &w, const char *mode) {
+    return w.mode == "all" || w.mode == mode;
+}
+
+int main(int argc, char **argv) {
+
+    Workload w;
+    w.mode = bench::flag_or(argc, argv, "mode", "all");
+    w.threads = static_cast<int>(bench::flag_or(argc, argv, "threads", 4L));
+    w.ops = bench::flag_or(argc, argv, "ops", 1000000L);
+    w.keys = bench::flag_or(argc, argv, "keys", 100000L);
+    w.dist = bench::flag_or(argc, argv, "dist", "uniform");
+    w.theta = std::atof(bench::flag_or(argc, argv, "theta", "0.99").c_str());
+    w.read_pct = static_cast<int>(bench::flag_or(argc, argv, "read", 90L));
+    w.delete_pct = static_cast<int>(bench::flag_or(argc, argv, "delete", 5L));
+    w.key_size = static_cast<int>(bench::flag_or(argc, argv, "key-size", 16L));
+    w.value_size = static_cast<int>(bench::flag_or(argc, argv, "value-size", 100L));
+    w.shards = static_cast<int>(bench::flag_or(argc, argv, "shards", 16L));
+    w.seed = bench::flag_or(argc, argv, "seed", 1L);
+    if (w.threads < 1 || w.keys < 1 || w.read_pct + w.delete_pct > 100 || !(w.theta > 0 && w.theta < 1) ||
+        w.key_size < static_cast<int>(std::to_string(w.keys - 1).size()) ||//key太短会截断成重复的key
+        (w.dist != "uniform" && w.dist != "zipfian" && w.dist != "sequential")) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    printf("threads=%d ops=%ld keys=%ld dist=%s read=%d%% delete=%d%% key-size=%d value-size=%d seed=%ld\n",
+           w.threads, w.ops, w.keys, w.dist.c_str(), w.read_pct, w.delete_pct, w.key_size, w.value_size, w.seed);
+    std::vector<std::vector<Op> > ops = make_ops(w);
+    printf("%-10s %12s %8s %8s %8s %8s %8s %8s %8s %8s\n", "mode", "ops/s", "p50", "p99", "p999",
+           "read p50", "read p99", "writ p50", "writ p99", "hit rate");
+    printf("(latency in ns, each sample includes ~%.0f ns of timer overhead)\n", bench::timer_overhead_ns());
+
+    typedef std::string Str;
+    if (selected(w, "skiplist")) {
+        SkipList<Str, Str> list(MAX_LEVEL);
+        run_list("skiplist", list, w, ops);
+    }
+    if (selected(w, "arena")) {
+        SkipList<Str, Str, std::less<Str>, ArenaNodeAllocator> list(MAX_LEVEL);
+        run_list("arena", list, w, ops);
+    }
+    if (selected(w, "sharded")) {
+        ShardedSkipList<Str, Str> list(MAX_LEVEL, HashPartitioner<Str>(w.shards));
+        run_list("sharded", list, w, ops);
+    }
+    if (selected(w, "rcu")) {
+        RcuSkipList<Str, Str> list(MAX_LEVEL);
+        run_list("rcu", list, w, ops);
+    }
+    if (selected(w, "lockfree")) {
+        LockFreeSkipList<Str, Str> list(MAX_LEVEL);
+        run_list("lockfree", list, w, ops);
+    }
+    return 0;
+}
@@ -0,0 +1,252 @@
+/* ************************************************************************
+> File Name:     bench_util.h
+> Description:   各个benchmark共用的小工具: 计时、多线程启动、随机数、内存统计
+ ************************************************************************/
+
+#ifndef SKIPLIST_BENCH_UTIL_H
+#define SKIPLIST_BENCH_UTIL_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+
+namespace bench {
+
+// 秒级计时
+inline double now_seconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 纳秒级计时，用于单次操作的延迟
+inline uint64_t now_nanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 每个线程独立的xorshift随机数，避免rand()的全局锁影响测试结果
+class Rng {
+public:
+    explicit Rng(uint64_t seed) : _state(seed * 0x9E3779B97F4A7C15ULL + 1) {}
+    uint64_t next() {
+        _state ^= _state << 13;
+        _state ^= _state >> 7;
+        _state ^= _state << 17;
+        return _state;
+    }
+    uint64_t next(uint64_t bound) { return next() % bound; }
+private:
+    uint64_t _state;
+};
+
+// 一次now_nanos()的平均耗时，用来说明单次延迟中计时本身占了多少
+inline double timer_overhead_ns() {
+    const int n = 100000;
+    uint64_t start = now_nanos();
+    uint64_t sink = 0;
+    for (int i = 0; i < n; i++) {
+        sink += now_nanos();
+    }
+    return (now_nanos() - start - (sink == 0 ? 1 : 0)) / static_cast<double>(n);
+}
+
+// Zipfian分布的整数[0, n)，算法同YCSB(Gray等人的方法)，theta越大越集中
+// 生成器构造后只读，多个线程可以共用，各自传入自己的Rng。
+// 排名直接作为key时热点都挤在小key上，scrambled为true时把排名hash到[0, n)中打散
+class Zipfian {
+public:
+    Zipfian(uint64_t n, double theta = 0.99, bool scrambled = true)
+        : _n(n), _theta(theta), _scrambled(scrambled) {
+        _zetan = zeta(n, theta);
+        double zeta2 = zeta(2, theta);
+        _alpha = 1.0 / (1.0 - theta);
+        _eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / _zetan);
+        _half_pow_theta = 1 + std::pow(0.5, theta);
+    }
+
+    uint64_t next(Rng &rng) const {
+        double u = static_cast<double>(rng.next() >> 11) / 9007199254740992.0;//[0, 1)
+        double uz = u * _zetan;
+        uint64_t rank;
+        if (uz < 1) {
+            rank = 0;
+        } else if (uz < _half_pow_theta) {
+            rank = 1;
+        } else {
+            rank = static_cast<uint64_t>(_n * std::pow(_eta * u - _eta + 1, _alpha));
+            rank = rank < _n ? rank : _n - 1;
+        }
+        return _scrambled ? fnv_hash(rank) % _n : rank;
+    }
+
+private:
+    static double zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; i++) {
+            sum += 1 / std::pow(static_cast<double>(i), theta);
+        }
+        return sum;
+    }
+
+    static uint64_t fnv_hash(uint64_t v) {
+        uint64_t h = 0xCBF29CE484222325ULL;
+        for (int i = 0; i < 8; i++) {
+            h ^= v & 0xFF;
+            h *= 0x100000001B3ULL;
+            v >>= 8;
+        }
+        return h;
+    }
+
+    uint64_t _n;
+    double _theta;
+    bool _scrambled;
+    double _zetan;
+    double _alpha;
+    double _eta;
+    double _half_pow_theta;
+};
+
+// 延迟直方图(纳秒)
+// 每个2的幂区间再线性分成16个子桶，分位数的相对误差在1/16以内。每个线程记自己的一份，最后合并
+class LatencyHistogram {
+public:
+    LatencyHistogram() : _count(0), _max(0), _buckets(BUCKETS, 0) {}
+
+    void record(uint64_t ns) {
+        _buckets[index_of(ns)]++;
+        _count++;
+        _max = ns > _max ? ns : _max;
+    }
+
+    void merge(const LatencyHistogram &other) {
+        for (int i = 0; i < BUCKETS; i++) {
+            _buckets[i] += other._buckets[i];
+        }
+        _count += other._count;
+        _max = other._max > _max ? other._max : _max;
+    }
+
+    uint64_t count() const { return _count; }
+
+    // 第p百分位所在子桶的上界(p取0~100)，不超过max
+    uint64_t percentile(double p) const {
+        uint64_t target = static_cast<uint64_t>(_count * p / 100);
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += _buckets[i];
+            if (seen > target) {
+                uint64_t upper = upper_of(i);
+                return upper < _max ? upper : _max;
+            }
+        }
+        return _max;
+    }
+
+private:
+    static const int SUB_BITS = 4;
+    static const int SUB = 1 << SUB_BITS;
+    static const int BUCKETS = (64 - SUB_BITS + 1) * SUB;
+
+    // 小于16的值各占一个桶；否则按最高位所在的区间和其后4位定位
+    static int index_of(uint64_t v) {
+        if (v < SUB) {
+            return static_cast<int>(v);
+        }
+        int msb = 63 - __builtin_clzll(v);
+        return (msb - SUB_BITS + 1) * SUB + static_cast<int>((v >> (msb - SUB_BITS)) & (SUB - 1));
+    }
+
+    static uint64_t upper_of(int index) {
+        if (index < SUB) {
+            return index;
+        }
+        int msb = index / SUB + SUB_BITS - 1;
+        uint64_t width = 1ULL << (msb - SUB_BITS);
+        return ((SUB + static_cast<uint64_t>(index % SUB)) << (msb - SUB_BITS)) + width - 1;
+    }
+
+    uint64_t _count;
+    uint64_t _max;
+    std::vector<uint64_t> _buckets;
+};
+
+// 启动n个线程执行fn(tid)并等待结束，返回耗时(秒)
+template<typename Fn>
+double run_threads(int n, Fn fn) {
+    std::vector<std::thread> threads;
+    double start = now_seconds();
+    for (int i = 0; i < n; i++) {
+        threads.push_back(std::thread(fn, i));
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    return now_seconds() - start;
+}
+
+// 被测代码可能往std::cout打印，测试期间把它重定向掉
+class QuietStdout {
+public:
+    QuietStdout() : _old(std::cout.rdbuf(NULL)) {}
+    ~QuietStdout() { std::cout.rdbuf(_old); std::cout.clear(); }
+private:
+    std::streambuf *_old;
+};
+
+// 当前进程的常驻内存(KB)，读取/proc/self/status
+inline long rss_kb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return std::atol(line.c_str() + 6);
+        }
+    }
+    return -1;
+}
+
+// 读取形如--name=value的参数，不存在时返回默认值
+inline std::string flag_or(int argc, char **argv, const std::string &name, const std::string &def) {
+    std::string prefix = "--" + name + "=";
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]).compare(0, prefix.size(), prefix) == 0) {
+            return argv[i] + prefix.size();
+        }
+    }
+    return def;
+}
+
+inline long flag_or(int argc, char **argv, const std::string &name, long def) {
+    std::string value = flag_or(argc, argv, name, std::string());
+    return value.empty() ? def : std::atol(value.c_str());
+}
+
+// 读取命令行中第i个整数参数，不存在时返回默认值
+inline long arg_or(int argc, char **argv, int i, long def) {
+    return argc > i ? std::atol(argv[i]) : def;
+}
+
+inline int hardware_threads() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : static_cast<int>(n);
+}
+
+// 线程数扩展序列: 1,2,4,...，最后一项固定为max_threads
+inline std::vector<int> thread_steps(int max_threads) {
+    std::vector<int> steps;
+    for (int n = 1; n < max_threads; n *= 2) {
+        steps.push_back(n);
+    }
+    steps.push_back(max_threads < 1 ? 1 : max_threads);
+    return steps;
+}
+
+}
+
+#endif
@@ -0,0 +1,92 @@
+/* ************************************************************************
+> File Name:     bg_snapshot_bench.cpp
+> Description:   写快照期间的写延迟: 不写快照 / dump_snapshot(全程持锁) / start_snapshot(后台)
+>                用法: ./bin/bg_snapshot_bench [key数量] [快照目录]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <unistd.h>
+#include "bench_util.h"
+#include "../skiplist.h"
+
+#define MAX_LEVEL 26
+
+typedef SkipList<int, int> List;
+
+// 一个写线程在action执行期间不停更新/插入/删除，打印写延迟分布
+template<typename Fn>
+void run(const char *name, List &list, long key_range, Fn action) {
+
+    std::atomic<bool> stop(false);
+    std::vector<uint64_t> latencies;
+    latencies.reserve(1 << 22);
+    std::thread writer([&]() {
+        bench::Rng rng(1);
+        while (!stop.load(std::memory_order_relaxed)) {
+            int key = static_cast<int>(rng.next(key_range));
+            uint64_t start = bench::now_nanos();
+            if (rng.next(8) == 0) {
+                list.delete_element(key);
+            } else {
+                list.insert_or_assign(key, key);
+            }
+            latencies.push_back(bench::now_nanos() - start);
+        }
+    });
+
+    double start = bench::now_seconds();
+    bool ok = action();
+    double elapsed = bench::now_seconds() - start;
+    stop.store(true);
+    writer.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    size_t n = latencies.size();
+    printf("%-16s %8.2f %12.0f %10.1f %10.1f %10.1f %12.1f%s\n", name, elapsed, n / elapsed,
+           latencies[n / 2] / 1000.0, latencies[n * 99 / 100] / 1000.0, latencies[n * 999 / 1000] / 1000.0,
+           latencies[n - 1] / 1000.0, ok ? "" : " (failed)");
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+
+    long count = bench::arg_or(argc, argv, 1, 10000000);
+    std::string path = std::string(argc > 2 ? argv[2] : "/tmp") + "/skiplist_bench.snap";
+
+    List list(MAX_LEVEL);
+    std::vector<std::pair<int, int> > items;
+    items.reserve(count);
+    for (long i = 0; i < count; i++) {
+        items.push_back(std::make_pair(static_cast<int>(i), static_cast<int>(i)));
+    }
+    list.bulk_load(items.begin(), items.end());
+    std::vector<std::pair<int, int> >().swap(items);
+
+    printf("keys: %ld, 1 writer (7/8 insert_or_assign, 1/8 delete)\n", count);
+    printf("%-16s %8s %12s %10s %10s %10s %12s\n", "snapshot", "seconds", "writes/s", "p50(us)", "p99(us)",
+           "p999(us)", "max(us)");
+
+    double blocking = 0;
+    run("dump_snapshot", list, count, [&]() {
+        double start = bench::now_seconds();
+        bool ok = list.dump_snapshot(path);
+        blocking = bench::now_seconds() - start;
+        return ok;
+    });
+    run("start_snapshot", list, count, [&]() {
+        return list.start_snapshot(path) && list.wait_snapshot();
+    });
+    run("none", list, count, [&]() {
+        usleep(static_cast<useconds_t>(blocking * 1e6));//与dump_snapshot同样长的时间
+        return true;
+    });
+
+    unlink(path.c_str());
+    return 0;
+}
@@ -0,0 +1,90 @@
+/* ************************************************************************
+> File Name:     block_bench.cpp
+> Description:   宽节点跳表(BlockSkipList)对比普通跳表: 整数key，随机顺序插入后随机查找，
+>                比较每key内存(节点和块本身，不含分配器开销)、插入和查找的耗时。key数量从100万开始每次乘10
+>                用法: ./bin/block_bench [最大key数量，默认1000万] [all|block]
+>                1亿个key时普通跳表约需6GB以上内存，内存不够时用block只跑宽节点跳表
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "../skiplist.h"
+#include "../block_skiplist.h"
+
+#define MAX_LEVEL 24
+#define QUERY_COUNT 2000000
+
+template<typename List>
+static void run_list(const char *name, List &list, const std::vector<int> &keys, const std::vector<int> &probes) {
+    double start = bench::now_seconds();
+    for (size_t i = 0; i < keys.size(); i++) {
+        list.insert_element(keys[i], keys[i]);
+    }
+    double insert_ns = (bench::now_seconds() - start) * 1e9 / keys.size();
+
+    long found = 0;
+    start = bench::now_seconds();
+    for (size_t i = 0; i < probes.size(); i++) {
+        found += list.search_element(probes[i]);
+    }
+    double search_ns = (bench::now_seconds() - start) * 1e9 / probes.size();
+
+    printf("%-8s %12.0f %12.0f%s", name, insert_ns, search_ns,
+           found == static_cast<long>(probes.size()) ? "" : " (missing keys)");
+}
+
+static void run_size(long count, bool classic) {
+    std::vector<int> keys;
+    for (long i = 0; i < count; i++) {
+        keys.push_back(static_cast<int>(i));
+    }
+    bench::Rng rng(count);
+    for (long i = count - 1; i > 0; i--) {
+        std::swap(keys[i], keys[rng.next(i + 1)]);
+    }
+    std::vector<int> probes;
+    for (long i = 0; i < QUERY_COUNT; i++) {
+        probes.push_back(static_cast<int>(rng.next(count)));
+    }
+
+    printf("%-10ld ", count);
+    if (classic) {
+        SkipList<int, int> list(MAX_LEVEL);
+        run_list("skiplist", list, keys, probes);
+        size_t bytes = 0;
+        for (SkipList<int, int>::iterator it = list.begin(); it != list.end(); ++it) {
+            bytes += Node<int, int>::block_size(it->node_level);
+        }
+        printf(" %10.1f\n", static_cast<double>(bytes) / count);
+        printf("%-10s ", "");
+    }
+    {
+        BlockSkipList<int, int> list(MAX_LEVEL);
+        run_list("block", list, keys, probes);
+        printf(" %10.1f   (%zu blocks, %.1f keys/block)\n", static_cast<double>(list.memory_usage()) / count,
+               list.block_count(), static_cast<double>(count) / list.block_count());
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+
+    long max_count = bench::arg_or(argc, argv, 1, 10000000);
+    bool classic = !(argc > 2 && std::string(argv[2]) == "block");
+#if defined(BLOCK_SKIPLIST_AVX2)
+    const char *simd = "AVX2";
+#elif defined(BLOCK_SKIPLIST_SSE)
+    const char *simd = "SSE";
+#else
+    const char *simd = "scalar";
+#endif
+    printf("block search: %s, %d keys per block\n", simd, BLOCK_KEYS);
+    printf("%-10s %-8s %12s %12s %10s\n", "keys", "list", "insert(ns)", "search(ns)", "bytes/key");
+    for (long count = 1000000; count <= max_count; count *= 10) {
+        run_size(count, classic);
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+/* ************************************************************************
+> File Name:     bulk_load_bench.cpp
+> Description:   逐条insert_element与bulk_load/insert_batch的建表速度对比
+>                用法: ./bin/bulk_load_bench [key数量]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+#include "bench_util.h"
+#include "../skiplist.h"
+
+#define MAX_LEVEL 26
+
+typedef std::vector<std::pair<int, std::string> > Items;
+typedef SkipList<int, std::string> List;
+
+template<typename Fn>
+void run(const char *name, const Items &items, Fn fn) {
+    List list(MAX_LEVEL);
+    double start = bench::now_seconds();
+    fn(list, items);
+    double elapsed = bench::now_seconds() - start;
+    printf("%-32s %10.3f %14.0f %10zu\n", name, elapsed, items.size() / elapsed, list.size());
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+
+    long count = bench::arg_or(argc, argv, 1, 1000000);
+
+    Items sorted;
+    sorted.reserve(count);
+    for (long i = 0; i < count; i++) {
+        sorted.push_back(std::make_pair(static_cast<int>(i), std::string("a")));
+    }
+    Items shuffled = sorted;
+    bench::Rng rng(7);
+    for (long i = count - 1; i > 0; i--) {
+        std::swap(shuffled[i], shuffled[rng.next(i + 1)]);
+    }
+
+    printf("keys: %ld\n", count);
+    printf("%-32s %10s %14s %10s\n", "method", "seconds", "keys/s", "size");
+    run("insert_element (sorted)", sorted, [](List &l, const Items &items) {
+        for (size_t i = 0; i < items.size(); i++) {
+            l.insert_element(items[i].first, items[i].second);
+        }
+    });
+    run("bulk_load (sorted)", sorted, [](List &l, const Items &items) {
+        l.bulk_load(items.begin(), items.end());
+    });
+    run("insert_element (shuffled)", shuffled, [](List &l, const Items &items) {
+        for (size_t i = 0; i < items.size(); i++) {
+            l.insert_element(items[i].first, items[i].second);
+        }
+    });
+    run("insert_batch (shuffled)", shuffled, [](List &l, const Items &items) {
+        l.insert_batch(items);
+    });
+    return 0;
+}
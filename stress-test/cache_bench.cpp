@@ -0,0 +1,99 @@
+/* ************************************************************************
+> File Name:     cache_bench.cpp
+> Description:   不同规模下随机查找的延迟和cache miss(通过perf_event_open读硬件计数器)
+>                用法: ./bin/cache_bench [最大key数量] [每轮查找次数]
+>                key数量从1M开始每次乘10，直到最大值
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "bench_util.h"
+#include "../skiplist.h"
+
+#define MAX_LEVEL 28
+
+// 单个硬件计数器，打不开时(容器/权限不足)valid()为false
+class PerfCounter {
+public:
+    PerfCounter(uint32_t type, uint64_t config) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        _fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    ~PerfCounter() { if (_fd >= 0) close(_fd); }
+    bool valid() const { return _fd >= 0; }
+    void start() {
+        if (_fd < 0) return;
+        ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    uint64_t stop() {
+        if (_fd < 0) return 0;
+        ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t value = 0;
+        if (read(_fd, &value, sizeof(value)) != sizeof(value)) return 0;
+        return value;
+    }
+private:
+    int _fd;
+};
+
+int main(int argc, char **argv) {
+
+    long max_keys = bench::arg_or(argc, argv, 1, 100000000);
+    long lookups = bench::arg_or(argc, argv, 2, 1000000);
+
+    PerfCounter cache_misses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    PerfCounter l1d_misses(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                           (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    if (!cache_misses.valid()) {
+        printf("perf counters unavailable, only reporting latency\n");
+    }
+
+    printf("%-12s %10s %10s %14s %14s\n", "keys", "ns/lookup", "ns/level", "LLC miss/op", "L1D miss/op");
+    for (long keys = 1000000; keys <= max_keys; keys *= 10) {
+        SkipList<int, std::string> list(MAX_LEVEL);
+        for (long i = 0; i < keys; i++) {
+            list.insert_element(static_cast<int>(static_cast<uint32_t>(i) * 2654435761u), "value");
+        }
+
+        bench::Rng rng(42);
+        cache_misses.start();
+        l1d_misses.start();
+        double start = bench::now_seconds();
+        for (long i = 0; i < lookups; i++) {
+            list.search_element(static_cast<int>(static_cast<uint32_t>(rng.next(keys)) * 2654435761u));
+        }
+        double elapsed = bench::now_seconds() - start;
+        uint64_t llc = cache_misses.stop();
+        uint64_t l1d = l1d_misses.stop();
+
+        double ns = elapsed * 1e9 / lookups;
+        double levels = std::log2(static_cast<double>(keys));//p=1/2时期望的下降层数
+        printf("%-12ld %10.1f %10.2f", keys, ns, ns / levels);
+        if (cache_misses.valid()) {
+            printf(" %14.2f", static_cast<double>(llc) / lookups);
+        } else {
+            printf(" %14s", "-");
+        }
+        if (l1d_misses.valid()) {
+            printf(" %14.2f\n", static_cast<double>(l1d) / lookups);
+        } else {
+            printf(" %14s\n", "-");
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,111 @@
+/* ************************************************************************
+> File Name:     compact_bench.cpp
+> Description:   省内存的字符串跳表(CompactSkipList)对比SkipList<std::string, std::string>:
+>                key为"user:%012ld"，value分短value(8字节)和长value(200字节，可压缩)两种，
+>                比较每key占用的堆内存(malloc统计，含分配器开销)、插入和查找的耗时，以及快照压缩前后的大小
+>                用法: ./bin/compact_bench [key数量，默认100万]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <malloc.h>
+#include <sys/stat.h>
+#include "bench_util.h"
+#include "../skiplist.h"
+#include "../compact_skiplist.h"
+
+#define MAX_LEVEL 20
+#define QUERY_COUNT 1000000
+#define SNAPSHOT_PATH "/tmp/compact_bench.snapshot"
+
+// 当前在用的堆内存字节数
+static size_t heap_bytes() {
+    return mallinfo2().uordblks;
+}
+
+static long file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? static_cast<long>(st.st_size) : -1;
+}
+
+static std::string make_key(long i) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "user:%012ld", i);
+    return buf;
+}
+
+static std::string make_value(long i, size_t size) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "v%07ld", i % 10000000);
+    std::string value(buf);
+    value.resize(size, 'x');
+    return value;
+}
+
+template<typename List>
+static void run(const char *name, List &list, const std::vector<long> &order, size_t value_size) {
+    long count = static_cast<long>(order.size());
+    size_t base = heap_bytes();
+    double start = bench::now_seconds();
+    for (long i = 0; i < count; i++) {
+        list.insert_element(make_key(order[i]), make_value(order[i], value_size));
+    }
+    double insert_ns = (bench::now_seconds() - start) * 1e9 / count;
+    size_t used = heap_bytes() - base;
+
+    std::vector<std::string> queries;
+    bench::Rng rng(3);
+    for (long i = 0; i < QUERY_COUNT; i++) {
+        queries.push_back(make_key(static_cast<long>(rng.next(count))));
+    }
+    long found = 0;
+    start = bench::now_seconds();
+    for (long i = 0; i < QUERY_COUNT; i++) {
+        found += list.search_element(queries[i]);
+    }
+    double search_ns = (bench::now_seconds() - start) * 1e9 / QUERY_COUNT;
+    printf("%-10s %-8zu %12.1f %10.0f %10.0f   (%ld found)\n", name, value_size,
+           static_cast<double>(used) / count, insert_ns, search_ns, found);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+
+    long count = bench::arg_or(argc, argv, 1, 1000000);
+    std::vector<long> order;
+    for (long i = 0; i < count; i++) {
+        order.push_back(i);
+    }
+    bench::Rng rng(7);
+    for (long i = count - 1; i > 0; i--) {
+        std::swap(order[i], order[rng.next(i + 1)]);
+    }
+
+    printf("keys: %ld, random insert order\n", count);
+    printf("%-10s %-8s %12s %10s %10s\n", "list", "value", "bytes/key", "insert ns", "search ns");
+    size_t sizes[] = {8, 200};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        {
+            SkipList<std::string, std::string> list(MAX_LEVEL);
+            run("skiplist", list, order, sizes[s]);
+        }
+        malloc_trim(0);
+        {
+            CompactSkipList list(MAX_LEVEL);
+            run("compact", list, order, sizes[s]);
+            printf("%-10s %-8zu %12.1f   (analytic memory_usage)\n", "compact", sizes[s],
+                   static_cast<double>(list.memory_usage()) / count);
+            list.dump_snapshot(SNAPSHOT_PATH, false);
+            long raw = file_size(SNAPSHOT_PATH);
+            list.dump_snapshot(SNAPSHOT_PATH, true);
+            long lz = file_size(SNAPSHOT_PATH);
+            printf("%-10s %-8zu snapshot %ld bytes raw, %ld bytes lz (%.1fx)\n", "compact", sizes[s], raw, lz,
+                   static_cast<double>(raw) / lz);
+        }
+        malloc_trim(0);
+    }
+    remove(SNAPSHOT_PATH);
+    return 0;
+}
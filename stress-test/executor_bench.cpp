@@ -0,0 +1,150 @@
+/* ************************************************************************
+> File Name:     executor_bench.cpp
+> Description:   异步执行层(SkipListExecutor)对比直接调用: 多个客户端线程执行读写混合负载，
+>                输出吞吐和p50/p99/p999延迟。执行层的延迟从提交到回调执行，客户端最多同时有window个未完成的操作
+>                用法: ./bin/executor_bench [--clients=32] [--workers=CPU核数] [--ops=2000000] [--keys=1000000]
+>                                           [--read=90] [--window=64] [--shards=16]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include "bench_util.h"
+#include "../skiplist.h"
+#include "../sharded_skiplist.h"
+#include "../skiplist_executor.h"
+
+#define MAX_LEVEL 18
+
+struct Config {
+    int clients;
+    int workers;
+    long ops;
+    long keys;
+    int read_pct;
+    int window;
+    int shards;
+};
+
+static void report(const char *name, const Config &c, double elapsed, std::vector<bench::LatencyHistogram> &hists,
+                   const std::vector<long> &hits) {
+    bench::LatencyHistogram all;
+    long found = 0;
+    for (int t = 0; t < c.clients; t++) {
+        all.merge(hists[t]);
+        found += hits[t];
+    }
+    printf("%-20s %12.0f %10llu %10llu %10llu   (%ld hits)\n", name, all.count() / elapsed,
+           (unsigned long long)all.percentile(50), (unsigned long long)all.percentile(99),
+           (unsigned long long)all.percentile(99.9), found);
+    fflush(stdout);
+}
+
+// 直接调用: 每个操作在客户端线程中同步执行
+template<typename List>
+static void run_direct(const char *name, List &list, const Config &c) {
+    for (long k = 0; k < c.keys; k += 2) {
+        list.insert_element(static_cast<int>(k), static_cast<int>(k));
+    }
+    std::vector<bench::LatencyHistogram> hists(c.clients);
+    std::vector<long> hits(c.clients);
+    double elapsed = bench::run_threads(c.clients, [&](int tid) {
+        bench::Rng rng(tid + 1);
+        long per_client = c.ops / c.clients;
+        long found = 0;
+        for (long i = 0; i < per_client; i++) {
+            int key = static_cast<int>(rng.next(c.keys));
+            bool read = static_cast<int>(rng.next(100)) < c.read_pct;
+            uint64_t start = bench::now_nanos();
+            if (read) {
+                found += list.search_element(key);
+            } else {
+                list.insert_element(key, static_cast<int>(i));
+            }
+            hists[tid].record(bench::now_nanos() - start);
+        }
+        hits[tid] = found;
+    });
+    report(name, c, elapsed, hists, hits);
+}
+
+// 执行层: 客户端提交后不等待，回调中记录延迟；未完成的操作达到window时才让出CPU等待
+static void run_executor(const Config &c) {
+    SkipListExecutor<int, int> ex(MAX_LEVEL, c.workers);
+    for (long k = 0; k < c.keys; k += 2) {
+        ex.insert_element(static_cast<int>(k), static_cast<int>(k), SkipListExecutor<int, int>::Callback());
+    }
+    ex.flush();
+
+    std::vector<bench::LatencyHistogram> hists(c.clients);
+    std::vector<long> hits(c.clients);
+    double elapsed = bench::run_threads(c.clients, [&](int tid) {
+        bench::Rng rng(tid + 1);
+        long per_client = c.ops / c.clients;
+        std::vector<uint64_t> latency(per_client);//每个槽只由一个回调写一次，客户端等outstanding归零后再读
+        std::atomic<long> outstanding(0);
+        std::atomic<long> found(0);
+        for (long i = 0; i < per_client; i++) {
+            int key = static_cast<int>(rng.next(c.keys));
+            bool read = static_cast<int>(rng.next(100)) < c.read_pct;
+            while (outstanding.load(std::memory_order_acquire) >= c.window) {
+                std::this_thread::yield();
+            }
+            outstanding.fetch_add(1, std::memory_order_relaxed);
+            uint64_t start = bench::now_nanos();
+            SkipListExecutor<int, int>::Callback done = [&latency, &outstanding, &found, i, start, read]
+                                                        (const ExecutorResult<int> &r) {
+                latency[i] = bench::now_nanos() - start;
+                if (read && r.code != 0) {
+                    found.fetch_add(1, std::memory_order_relaxed);
+                }
+                outstanding.fetch_sub(1, std::memory_order_release);
+            };
+            if (read) {
+                ex.find(key, done);
+            } else {
+                ex.insert_element(key, static_cast<int>(i), done);
+            }
+        }
+        while (outstanding.load(std::memory_order_acquire) != 0) {
+            std::this_thread::yield();
+        }
+        for (long i = 0; i < per_client; i++) {
+            hists[tid].record(latency[i]);
+        }
+        hits[tid] = found.load();
+    });
+    report("executor", c, elapsed, hists, hits);
+}
+
+int main(int argc, char **argv) {
+
+    Config c;
+    c.clients = static_cast<int>(bench::flag_or(argc, argv, "clients", 32L));
+    c.workers = static_cast<int>(bench::flag_or(argc, argv, "workers", static_cast<long>(bench::hardware_threads())));
+    c.ops = bench::flag_or(argc, argv, "ops", 2000000L);
+    c.keys = bench::flag_or(argc, argv, "keys", 1000000L);
+    c.read_pct = static_cast<int>(bench::flag_or(argc, argv, "read", 90L));
+    c.window = static_cast<int>(bench::flag_or(argc, argv, "window", 64L));
+    c.shards = static_cast<int>(bench::flag_or(argc, argv, "shards", 16L));
+    if (c.clients < 1 || c.workers < 1 || c.keys < 1 || c.window < 1 || c.shards < 1) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    printf("clients=%d workers=%d ops=%ld keys=%ld read=%d%% window=%d (%d hardware threads)\n", c.clients,
+           c.workers, c.ops, c.keys, c.read_pct, c.window, bench::hardware_threads());
+    printf("%-20s %12s %10s %10s %10s\n", "mode", "ops/s", "p50(ns)", "p99(ns)", "p999(ns)");
+    {
+        SkipList<int, int> list(MAX_LEVEL);
+        run_direct("direct skiplist", list, c);
+    }
+    {
+        ShardedSkipList<int, int> list(MAX_LEVEL, HashPartitioner<int>(c.shards));
+        run_direct("direct sharded", list, c);
+    }
+    run_executor(c);
+    return 0;
+}
@@ -0,0 +1,88 @@
+/* ************************************************************************
+> File Name:     finger_bench.cpp
+> Description:   手指对有序、近似有序、随机顺序插入和查找的影响
+>                用法: ./bin/finger_bench [key数量] [近似有序的乱序窗口]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <vector>
+#include "bench_util.h"
+#include "../skiplist.h"
+
+#define MAX_LEVEL 18
+
+typedef SkipList<long, long> List;
+
+// 每次操作的平均纳秒数
+template<typename Fn>
+double time_ns(long ops, Fn fn) {
+    double start = bench::now_seconds();
+    fn();
+    return (bench::now_seconds() - start) * 1e9 / ops;
+}
+
+static void run(const char *name, const std::vector<long> &keys) {
+    long n = static_cast<long>(keys.size());
+    List plain(MAX_LEVEL);
+    List fingered(MAX_LEVEL);
+    List::Finger finger;
+    long found = 0;
+
+    double insert_plain = time_ns(n, [&]() {
+        for (long i = 0; i < n; i++) {
+            plain.insert_element(keys[i], i);
+        }
+    });
+    double insert_finger = time_ns(n, [&]() {
+        for (long i = 0; i < n; i++) {
+            fingered.insert_element(keys[i], i, finger);
+        }
+    });
+    double search_plain = time_ns(n, [&]() {
+        for (long i = 0; i < n; i++) {
+            found += plain.search_element(keys[i]);
+        }
+    });
+    double search_finger = time_ns(n, [&]() {
+        for (long i = 0; i < n; i++) {
+            found += fingered.search_element(keys[i], finger);
+        }
+    });
+    printf("%-14s %10.0f %10.0f %8.2fx %10.0f %10.0f %8.2fx%s\n", name, insert_plain, insert_finger,
+           insert_plain / insert_finger, search_plain, search_finger, search_plain / search_finger,
+           found == 2 * n ? "" : " (missing keys)");
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+
+    long count = bench::arg_or(argc, argv, 1, 1000000);
+    long window = bench::arg_or(argc, argv, 2, 64);
+
+    std::vector<long> sorted, nearly, random;
+    bench::Rng rng(7);
+    for (long i = 0; i < count; i++) {
+        sorted.push_back(i);
+    }
+    // 近似有序: 时间戳类数据，每window个key内部打乱，key离有序位置不超过window
+    nearly = sorted;
+    for (long base = 0; base < count; base += window) {
+        long end = base + window < count ? base + window : count;
+        for (long i = end - 1; i > base; i--) {
+            std::swap(nearly[i], nearly[base + static_cast<long>(rng.next(i - base + 1))]);
+        }
+    }
+    random = sorted;
+    for (long i = count - 1; i > 0; i--) {
+        std::swap(random[i], random[rng.next(i + 1)]);
+    }
+
+    printf("keys: %ld, window: %ld (ns per op)\n", count, window);
+    printf("%-14s %10s %10s %9s %10s %10s %9s\n", "order", "insert", "+finger", "speedup", "search", "+finger",
+           "speedup");
+    run("sorted", sorted);
+    run("nearly sorted", nearly);
+    run("random", random);
+    return 0;
+}
@@ -0,0 +1,69 @@
+/* ************************************************************************
+> File Name:     height_bench.cpp
+> Description:   最大层数自动增长: 从很小的初始层数开始插入100到1000万个key，
+>                看最大层数是否跟上log(n)，以及查找的比较次数/耗时是否按O(log n)增长
+>                用法: ./bin/height_bench [最大key数量] [初始最大层数]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include "bench_util.h"
+#include "../skiplist.h"
+
+#define QUERY_COUNT 1000000
+
+// 统计比较次数的比较函数
+static uint64_t g_comparisons = 0;
+struct CountingLess {
+    bool operator()(int a, int b) const {
+        g_comparisons++;
+        return a < b;
+    }
+};
+
+static void run_size(long count, int initial_level) {
+    std::vector<int> keys;
+    for (long i = 0; i < count; i++) {
+        keys.push_back(static_cast<int>(i));
+    }
+    bench::Rng rng(count);
+    for (long i = count - 1; i > 0; i--) {
+        std::swap(keys[i], keys[rng.next(i + 1)]);
+    }
+
+    SkipList<int, int, CountingLess> list(initial_level);
+    double start = bench::now_seconds();
+    for (long i = 0; i < count; i++) {
+        list.insert_element(keys[i], keys[i]);
+    }
+    double insert_ns = (bench::now_seconds() - start) * 1e9 / count;
+
+    g_comparisons = 0;
+    long found = 0;
+    start = bench::now_seconds();
+    for (long i = 0; i < QUERY_COUNT; i++) {
+        found += list.search_element(keys[rng.next(count)]);
+    }
+    double search_ns = (bench::now_seconds() - start) * 1e9 / QUERY_COUNT;
+    double compares = static_cast<double>(g_comparisons) / QUERY_COUNT;
+
+    printf("%-10ld %10d %12.0f %12.0f %12.1f %12.2f%s\n", count, list.max_level(), insert_ns, search_ns,
+           compares, compares / std::log2(static_cast<double>(count)), found == QUERY_COUNT ? "" : " (missing keys)");
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+
+    long max_count = bench::arg_or(argc, argv, 1, 10000000);
+    int initial_level = static_cast<int>(bench::arg_or(argc, argv, 2, 1));
+
+    printf("initial max level: %d, p = 1/2\n", initial_level);
+    printf("%-10s %10s %12s %12s %12s %12s\n", "keys", "max level", "insert(ns)", "search(ns)", "compares",
+           "cmp/log2(n)");
+    for (long count = 100; count <= max_count; count *= 10) {
+        run_size(count, initial_level);
+    }
+    return 0;
+}
@@ -0,0 +1,115 @@
+/* ************************************************************************
+> File Name:     indexable_bench.cpp
+> Description:   可索引跳表维护跨度的代价(插入/查找/删除对比SkipList)，以及rank/at与线性遍历的对比
+>                用法: ./bin/indexable_bench [key数量]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <vector>
+#include "bench_util.h"
+#include "../skiplist.h"
+#include "../indexable_skiplist.h"
+
+#define MAX_LEVEL 26
+#define QUERY_COUNT 200000
+#define LINEAR_QUERY_COUNT 100 // SkipList只能沿第0层数过去，只做少量
+
+// 每次操作的平均纳秒数
+template<typename Fn>
+double time_ns(long ops, Fn fn) {
+    double start = bench::now_seconds();
+    fn();
+    return (bench::now_seconds() - start) * 1e9 / ops;
+}
+
+template<typename List>
+void run_updates(const char *name, List &list, const std::vector<int> &keys, const std::vector<int> &deletes) {
+    long n = static_cast<long>(keys.size());
+    double insert_ns, search_ns, delete_ns;
+    long found = 0;
+    insert_ns = time_ns(n, [&]() {
+        for (long i = 0; i < n; i++) {
+            list.insert_element(keys[i], keys[i]);
+        }
+    });
+    search_ns = time_ns(n, [&]() {
+        for (long i = 0; i < n; i++) {
+            found += list.search_element(keys[i]);
+        }
+    });
+    delete_ns = time_ns(static_cast<long>(deletes.size()), [&]() {
+        for (size_t i = 0; i < deletes.size(); i++) {
+            list.delete_element(deletes[i]);
+        }
+    });
+    printf("%-20s %12.0f %12.0f %12.0f%s\n", name, insert_ns, search_ns, delete_ns, found == n ? "" : " (missing keys)");
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+
+    long count = bench::arg_or(argc, argv, 1, 1000000);
+
+    std::vector<int> keys;
+    for (long i = 0; i < count; i++) {
+        keys.push_back(static_cast<int>(i));
+    }
+    bench::Rng rng(7);
+    for (long i = count - 1; i > 0; i--) {
+        std::swap(keys[i], keys[rng.next(i + 1)]);
+    }
+    std::vector<int> deletes(keys.begin(), keys.begin() + count / 2);
+
+    SkipList<int, int> plain(MAX_LEVEL);
+    IndexableSkipList<int, int> indexed(MAX_LEVEL);
+    printf("keys: %ld (then delete half)\n", count);
+    printf("%-20s %12s %12s %12s\n", "list", "insert(ns)", "search(ns)", "delete(ns)");
+    run_updates("SkipList", plain, keys, deletes);
+    run_updates("IndexableSkipList", indexed, keys, deletes);
+
+    // 剩下的key中随机查rank和第k个元素
+    int remain = indexed.size();
+    long sum = 0;
+    printf("\n%-20s %12s %12s\n", "query", "rank(ns)", "at(ns)");
+    double rank_ns = time_ns(QUERY_COUNT, [&]() {
+        for (long i = 0; i < QUERY_COUNT; i++) {
+            sum += indexed.rank(keys[count / 2 + rng.next(count - count / 2)]);
+        }
+    });
+    double at_ns = time_ns(QUERY_COUNT, [&]() {
+        int key = 0;
+        for (long i = 0; i < QUERY_COUNT; i++) {
+            if (indexed.at(static_cast<int>(rng.next(remain)), &key, NULL)) {
+                sum += key;
+            }
+        }
+    });
+    printf("%-20s %12.0f %12.0f\n", "IndexableSkipList", rank_ns, at_ns);
+
+    double linear_rank_ns = time_ns(LINEAR_QUERY_COUNT, [&]() {
+        for (long i = 0; i < LINEAR_QUERY_COUNT; i++) {
+            int key = keys[count / 2 + rng.next(count - count / 2)];
+            int pos = 0;
+            for (SkipList<int, int>::iterator it = plain.begin(); it != plain.end() && it->get_key() < key; ++it) {
+                pos++;
+            }
+            sum += pos;
+        }
+    });
+    double linear_at_ns = time_ns(LINEAR_QUERY_COUNT, [&]() {
+        for (long i = 0; i < LINEAR_QUERY_COUNT; i++) {
+            long index = static_cast<long>(rng.next(remain));
+            SkipList<int, int>::iterator it = plain.begin();
+            for (long j = 0; j < index; j++) {
+                ++it;
+            }
+            sum += it->get_key();
+        }
+    });
+    printf("%-20s %12.0f %12.0f\n", "SkipList (linear)", linear_rank_ns, linear_at_ns);
+    if (sum == 42) {
+        printf("\n");//防止结果被优化掉
+    }
+    return 0;
+}
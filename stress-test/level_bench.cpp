@@ -0,0 +1,112 @@
+/* ************************************************************************
+> File Name:     level_bench.cpp
+> Description:   不同升层概率p(1/2、1/4、1/e)下的每key内存、查找耗时和比较次数，
+>                以及生成一次层数的耗时(对比原来逐层调用rand()的做法)
+>                用法: ./bin/level_bench [key数量] [线程数]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <atomic>
+#include "bench_util.h"
+#include "../skiplist.h"
+
+#define MAX_LEVEL 32
+#define DRAW_COUNT 10000000
+
+// 统计比较次数的比较函数
+static uint64_t g_comparisons = 0;
+struct CountingLess {
+    bool operator()(int a, int b) const {
+        g_comparisons++;
+        return a < b;
+    }
+};
+
+static std::atomic<long> g_sink(0);
+
+// 原来的做法: 逐层调用rand()，最低为1层
+static int legacy_level() {
+    int k = 1;
+    while (rand() % 2) {
+        k++;
+    }
+    return k < MAX_LEVEL ? k : MAX_LEVEL;
+}
+
+static void run_p(const char *name, double p, const std::vector<int> &keys, const std::vector<int> &probes) {
+    SkipList<int, int, CountingLess> list(MAX_LEVEL);
+    list.set_level_probability(p);
+    for (size_t i = 0; i < keys.size(); i++) {
+        list.insert_element(keys[i], keys[i]);
+    }
+
+    // 节点整块内存(含forward数组)，不含分配器自身的开销
+    size_t bytes = 0;
+    size_t pointers = 0;
+    for (SkipList<int, int, CountingLess>::iterator it = list.begin(); it != list.end(); ++it) {
+        bytes += Node<int, int>::block_size(it->node_level);
+        pointers += it->node_level + 1;
+    }
+
+    g_comparisons = 0;
+    long found = 0;
+    double start = bench::now_seconds();
+    for (size_t i = 0; i < probes.size(); i++) {
+        found += list.search_element(probes[i]);
+    }
+    double search_ns = (bench::now_seconds() - start) * 1e9 / probes.size();
+
+    printf("%-8s %12.1f %12.2f %12.0f %12.1f%s\n", name, static_cast<double>(bytes) / keys.size(),
+           static_cast<double>(pointers) / keys.size(), search_ns,
+           static_cast<double>(g_comparisons) / probes.size(), found == static_cast<long>(probes.size()) ? "" : " (missing keys)");
+    fflush(stdout);
+}
+
+// 多个线程同时生成层数，每次的平均纳秒数
+template<typename Fn>
+static double draw_ns(int threads, Fn fn) {
+    double elapsed = bench::run_threads(threads, [&](int) {
+        long sum = 0;
+        for (long i = 0; i < DRAW_COUNT; i++) {
+            sum += fn();
+        }
+        g_sink.fetch_add(sum);//使用结果，防止循环被优化掉
+    });
+    return elapsed * 1e9 / DRAW_COUNT;
+}
+
+int main(int argc, char **argv) {
+
+    long count = bench::arg_or(argc, argv, 1, 1000000);
+    int threads = static_cast<int>(bench::arg_or(argc, argv, 2, 4));
+
+    std::vector<int> keys;
+    for (long i = 0; i < count; i++) {
+        keys.push_back(static_cast<int>(i));
+    }
+    bench::Rng rng(7);
+    for (long i = count - 1; i > 0; i--) {
+        std::swap(keys[i], keys[rng.next(i + 1)]);
+    }
+    std::vector<int> probes;
+    for (long i = 0; i < count; i++) {
+        probes.push_back(static_cast<int>(rng.next(count)));
+    }
+
+    printf("keys: %ld\n", count);
+    printf("%-8s %12s %12s %12s %12s\n", "p", "bytes/key", "ptrs/key", "search(ns)", "compares");
+    run_p("1/2", SKIPLIST_P_HALF, keys, probes);
+    run_p("1/4", SKIPLIST_P_QUARTER, keys, probes);
+    run_p("1/e", SKIPLIST_P_INV_E, keys, probes);
+
+    LevelGenerator half(MAX_LEVEL, SKIPLIST_P_HALF);
+    LevelGenerator inv_e(MAX_LEVEL, SKIPLIST_P_INV_E);
+    printf("\nlevel draw, %d threads (ns per draw, wall time)\n", threads);
+    printf("%-20s %12.1f\n", "rand() per level", draw_ns(threads, legacy_level));
+    printf("%-20s %12.1f\n", "xorshift, p=1/2", draw_ns(threads, [&]() { return half.next(); }));
+    printf("%-20s %12.1f\n", "xorshift, p=1/e", draw_ns(threads, [&]() { return inv_e.next(); }));
+    return 0;
+}
@@ -0,0 +1,64 @@
+/* ************************************************************************
+> File Name:     lockfree_bench.cpp
+> Description:   对比全局互斥锁版SkipList与LockFreeSkipList在1~N线程下的写吞吐
+>                用法: ./bin/lockfree_bench [最大线程数] [总操作数] [key范围]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include "bench_util.h"
+#include "../skiplist.h"
+#include "../lockfree_skiplist.h"
+
+#define MAX_LEVEL 18
+
+// 写密集负载: 一半插入一半删除，key在[0, key_range)中均匀分布
+template<typename List>
+double run_mixed(List &list, int threads, long total_ops, long key_range) {
+    long per_thread = total_ops / threads;
+    double elapsed = bench::run_threads(threads, [&](int tid) {
+        bench::Rng rng(tid + 1);
+        for (long i = 0; i < per_thread; i++) {
+            int key = static_cast<int>(rng.next(key_range));
+            if (rng.next() & 1) {
+                list.insert_element(key, "a");
+            } else {
+                list.delete_element(key);
+            }
+        }
+    });
+    return per_thread * threads / elapsed;
+}
+
+template<typename List>
+void prefill(List &list, long key_range) {
+    for (long i = 0; i < key_range; i += 2) {
+        list.insert_element(static_cast<int>(i), "a");
+    }
+}
+
+int main(int argc, char **argv) {
+
+    int max_threads = static_cast<int>(bench::arg_or(argc, argv, 1, bench::hardware_threads()));
+    long total_ops = bench::arg_or(argc, argv, 2, 1000000);
+    long key_range = bench::arg_or(argc, argv, 3, 100000);
+
+    printf("%-8s %16s %16s %8s\n", "threads", "mutex(ops/s)", "lockfree(ops/s)", "speedup");
+    std::vector<int> steps = bench::thread_steps(max_threads);
+    for (size_t s = 0; s < steps.size(); s++) {
+        int threads = steps[s];
+        double mutex_ops, lockfree_ops;
+        {
+            SkipList<int, std::string> list(MAX_LEVEL);
+            prefill(list, key_range);
+            mutex_ops = run_mixed(list, threads, total_ops, key_range);
+        }
+        {
+            LockFreeSkipList<int, std::string> list(MAX_LEVEL);
+            prefill(list, key_range);
+            lockfree_ops = run_mixed(list, threads, total_ops, key_range);
+        }
+        printf("%-8d %16.0f %16.0f %7.2fx\n", threads, mutex_ops, lockfree_ops, lockfree_ops / mutex_ops);
+    }
+    return 0;
+}
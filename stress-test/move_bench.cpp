@@ -0,0 +1,87 @@
+/* ************************************************************************
+> File Name:     move_bench.cpp
+> Description:   比较各插入接口对大value的拷贝字节数和每次插入耗时
+>                用法: ./bin/move_bench [插入次数] [value字节数]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include "bench_util.h"
+#include "../skiplist.h"
+
+#define MAX_LEVEL 18
+
+static size_t g_copied_bytes = 0;
+
+// 拷贝时累计字节数，移动不计
+struct Blob {
+    Blob() {}
+    Blob(size_t n, char c) : data(n, c) {}
+    Blob(const Blob &other) : data(other.data) { g_copied_bytes += data.size(); }
+    Blob(Blob &&other) noexcept : data(std::move(other.data)) {}
+    Blob &operator=(const Blob &other) { data = other.data; g_copied_bytes += data.size(); return *this; }
+    Blob &operator=(Blob &&other) noexcept { data = std::move(other.data); return *this; }
+    std::string data;
+};
+
+typedef SkipList<int, Blob> BlobList;
+
+// fn(list, key, value)执行一次插入；先插入count个新key，再对同样的key各更新一次
+template<typename Fn>
+void run(const char *name, long count, size_t value_size, Fn fn) {
+
+    BlobList list(MAX_LEVEL);
+    Blob value(value_size, 'x');
+
+    g_copied_bytes = 0;
+    double start = bench::now_seconds();
+    for (long i = 0; i < count; i++) {
+        fn(list, static_cast<int>(i), value);
+    }
+    double insert_ns = (bench::now_seconds() - start) * 1e9 / count;
+    size_t insert_bytes = g_copied_bytes;
+
+    g_copied_bytes = 0;
+    start = bench::now_seconds();
+    for (long i = 0; i < count; i++) {
+        fn(list, static_cast<int>(i), value);
+    }
+    double update_ns = (bench::now_seconds() - start) * 1e9 / count;
+    size_t update_bytes = g_copied_bytes;
+
+    printf("%-36s %12.1f %14.0f %12.1f %14.0f\n", name,
+           insert_ns, static_cast<double>(insert_bytes) / count,
+           update_ns, static_cast<double>(update_bytes) / count);
+}
+
+int main(int argc, char **argv) {
+
+    long count = bench::arg_or(argc, argv, 1, 200000);
+    size_t value_size = static_cast<size_t>(bench::arg_or(argc, argv, 2, 4096));
+
+    printf("inserts: %ld, value: %zu bytes\n", count, value_size);
+    printf("%-36s %12s %14s %12s %14s\n", "api", "insert ns", "insert B/op", "update ns", "update B/op");
+
+    run("insert_element(k, lvalue)", count, value_size, [](BlobList &l, int k, const Blob &v) {
+        l.insert_element(k, v);
+    });
+    run("insert_element(k, rvalue)", count, value_size, [](BlobList &l, int k, const Blob &v) {
+        Blob tmp(v.data.size(), 'x');
+        l.insert_element(k, std::move(tmp));
+    });
+    run("insert_or_assign(k, lvalue)", count, value_size, [](BlobList &l, int k, const Blob &v) {
+        l.insert_or_assign(k, v);
+    });
+    run("insert_or_assign(k, rvalue)", count, value_size, [](BlobList &l, int k, const Blob &v) {
+        Blob tmp(v.data.size(), 'x');
+        l.insert_or_assign(k, std::move(tmp));
+    });
+    run("try_emplace(k, n, c)", count, value_size, [](BlobList &l, int k, const Blob &v) {
+        l.try_emplace(k, v.data.size(), 'x');
+    });
+    run("emplace(k, n, c)", count, value_size, [](BlobList &l, int k, const Blob &v) {
+        l.emplace(k, v.data.size(), 'x');
+    });
+    return 0;
+}
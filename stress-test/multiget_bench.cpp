@@ -0,0 +1,86 @@
+/* ************************************************************************
+> File Name:     multiget_bench.cpp
+> Description:   批量查找: 逐个find与find_batch的每key耗时对比，key随机分布和局部聚集两种情况
+>                用法: ./bin/multiget_bench [key数量] [每批key数]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <vector>
+#include "bench_util.h"
+#include "../skiplist.h"
+
+#define MAX_LEVEL 26
+#define BATCH_ROUNDS 50000
+
+typedef SkipList<int, int> List;
+
+// make_key(rng, j)生成一批中的第j个key
+template<typename MakeKey>
+void run(const char *name, List &list, int batch, MakeKey make_key) {
+
+    bench::Rng rng(3);
+    std::vector<std::vector<int> > batches(BATCH_ROUNDS);
+    for (int r = 0; r < BATCH_ROUNDS; r++) {
+        for (int j = 0; j < batch; j++) {
+            batches[r].push_back(make_key(rng, j));
+        }
+    }
+    long total = static_cast<long>(BATCH_ROUNDS) * batch;
+    long found = 0;
+
+    double start = bench::now_seconds();
+    for (int r = 0; r < BATCH_ROUNDS; r++) {
+        for (int j = 0; j < batch; j++) {
+            found += list.find(batches[r][j]).has_value();
+        }
+    }
+    double single_ns = (bench::now_seconds() - start) * 1e9 / total;
+
+    start = bench::now_seconds();
+    for (int r = 0; r < BATCH_ROUNDS; r++) {
+        std::vector<std::optional<int> > values = list.find_batch(batches[r]);
+        for (size_t j = 0; j < values.size(); j++) {
+            found -= values[j].has_value();
+        }
+    }
+    double batch_ns = (bench::now_seconds() - start) * 1e9 / total;
+
+    printf("%-12s %12.0f %12.0f %9.2fx%s\n", name, single_ns, batch_ns, single_ns / batch_ns,
+           found == 0 ? "" : " (mismatch)");
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+
+    long count = bench::arg_or(argc, argv, 1, 1000000);
+    int batch = static_cast<int>(bench::arg_or(argc, argv, 2, 64));
+
+    List list(MAX_LEVEL);
+    std::vector<int> keys;
+    for (long i = 0; i < count; i++) {
+        keys.push_back(static_cast<int>(i));
+    }
+    bench::Rng rng(7);
+    for (long i = count - 1; i > 0; i--) {
+        std::swap(keys[i], keys[rng.next(i + 1)]);
+    }
+    for (long i = 0; i < count; i++) {
+        list.insert_or_assign(keys[i], keys[i]);
+    }
+
+    printf("keys: %ld, batch: %d\n", count, batch);
+    printf("%-12s %12s %12s %10s\n", "keys", "find(ns)", "batch(ns)", "speedup");
+    run("uniform", list, batch, [count](bench::Rng &r, int) {
+        return static_cast<int>(r.next(count));
+    });
+    // 同一批key落在一个小区间内(比如同一用户的多条记录)
+    int base = 0;
+    run("clustered", list, batch, [count, &base](bench::Rng &r, int j) {
+        if (j == 0) {
+            base = static_cast<int>(r.next(count - 4096));
+        }
+        return base + static_cast<int>(r.next(4096));
+    });
+    return 0;
+}
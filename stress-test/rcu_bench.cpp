@@ -0,0 +1,78 @@
+/* ************************************************************************
+> File Name:     rcu_bench.cpp
+> Description:   一个写线程持续插入/删除的同时，测量1~N个读线程的查找吞吐
+>                用法: ./bin/rcu_bench [最大读线程数] [每轮秒数] [key范围]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <atomic>
+#include "bench_util.h"
+#include "../skiplist.h"
+#include "../rcu_skiplist.h"
+
+#define MAX_LEVEL 18
+
+// 返回读线程的总查找次数/秒
+template<typename List>
+double run_readers(List &list, int readers, double seconds, long key_range) {
+
+    for (long i = 0; i < key_range; i += 2) {
+        list.insert_element(static_cast<int>(i), "a");
+    }
+
+    std::atomic<bool> stop(false);
+    std::atomic<long> lookups(0);
+    double elapsed = bench::run_threads(readers + 1, [&](int tid) {
+        bench::Rng rng(tid + 1);
+        if (tid == 0) {
+            // 写线程: 直到读线程结束前一直修改
+            double end = bench::now_seconds() + seconds;
+            while (bench::now_seconds() < end) {
+                for (int i = 0; i < 256; i++) {
+                    int key = static_cast<int>(rng.next(key_range));
+                    if (rng.next() & 1) {
+                        list.insert_element(key, "a");
+                    } else {
+                        list.delete_element(key);
+                    }
+                }
+            }
+            stop.store(true);
+            return;
+        }
+        long n = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            for (int i = 0; i < 256; i++) {
+                list.search_element(static_cast<int>(rng.next(key_range)));
+            }
+            n += 256;
+        }
+        lookups.fetch_add(n);
+    });
+    return lookups.load() / elapsed;
+}
+
+int main(int argc, char **argv) {
+
+    int max_readers = static_cast<int>(bench::arg_or(argc, argv, 1, bench::hardware_threads()));
+    double seconds = static_cast<double>(bench::arg_or(argc, argv, 2, 1));
+    long key_range = bench::arg_or(argc, argv, 3, 100000);
+
+    printf("%-8s %18s %18s %8s\n", "readers", "mutex(lookup/s)", "rcu(lookup/s)", "speedup");
+    std::vector<int> steps = bench::thread_steps(max_readers);
+    for (size_t s = 0; s < steps.size(); s++) {
+        int readers = steps[s];
+        double mutex_ops, rcu_ops;
+        {
+            SkipList<int, std::string> list(MAX_LEVEL);
+            mutex_ops = run_readers(list, readers, seconds, key_range);
+        }
+        {
+            RcuSkipList<int, std::string> list(MAX_LEVEL);
+            rcu_ops = run_readers(list, readers, seconds, key_range);
+        }
+        printf("%-8d %18.0f %18.0f %7.2fx\n", readers, mutex_ops, rcu_ops, rcu_ops / mutex_ops);
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+/* ************************************************************************
+> File Name:     scan_bench.cpp
+> Description:   范围扫描的吞吐(keys/s): range回调、迭代器、逐个search_element，扫描长度100~1M
+>                用法: ./bin/scan_bench [key数量]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <vector>
+#include "bench_util.h"
+#include "../skiplist.h"
+
+#define MAX_LEVEL 26
+#define KEYS_PER_ROUND 4000000  // 每种扫描长度总共扫描的key数
+
+typedef SkipList<int, int> List;
+
+int main(int argc, char **argv) {
+
+    long count = bench::arg_or(argc, argv, 1, 2000000);
+
+    // 随机顺序插入，让相邻key的节点在内存中也不相邻，接近真实负载
+    List list(MAX_LEVEL);
+    std::vector<std::pair<int, int> > items;
+    for (long i = 0; i < count; i++) {
+        items.push_back(std::make_pair(static_cast<int>(i), static_cast<int>(i)));
+    }
+    bench::Rng rng(7);
+    for (long i = count - 1; i > 0; i--) {
+        std::swap(items[i], items[rng.next(i + 1)]);
+    }
+    for (long i = 0; i < count; i++) {
+        list.insert_or_assign(items[i].first, items[i].second);
+    }
+
+    printf("keys: %ld\n", count);
+    printf("%-10s %14s %14s %14s\n", "length", "range", "iterator", "search");
+    for (long len = 100; len <= 1000000 && len <= count; len *= 10) {
+        long rounds = KEYS_PER_ROUND / len;
+        std::vector<int> starts;
+        for (long r = 0; r < rounds; r++) {
+            starts.push_back(static_cast<int>(rng.next(count - len + 1)));
+        }
+        long sum = 0;
+
+        double start = bench::now_seconds();
+        for (long r = 0; r < rounds; r++) {
+            list.range(starts[r], static_cast<int>(starts[r] + len), [&sum](const int &, const int &v) { sum += v; });
+        }
+        double range_rate = rounds * len / (bench::now_seconds() - start);
+
+        start = bench::now_seconds();
+        for (long r = 0; r < rounds; r++) {
+            List::iterator it = list.lower_bound(starts[r]);
+            for (long i = 0; i < len && it != list.end(); i++, ++it) {
+                sum += it->get_value();
+            }
+        }
+        double iter_rate = rounds * len / (bench::now_seconds() - start);
+
+        // 以前只能逐个查找，扫描越长越慢，只测一小部分
+        long search_keys = len < 10000 ? len : 10000;
+        start = bench::now_seconds();
+        for (long r = 0; r < rounds && r < 100; r++) {
+            for (long i = 0; i < search_keys; i++) {
+                sum += list.search_element(static_cast<int>(starts[r] + i));
+            }
+        }
+        double search_rate = (rounds < 100 ? rounds : 100) * search_keys / (bench::now_seconds() - start);
+
+        printf("%-10ld %14.0f %14.0f %14.0f\n", len, range_rate, iter_rate, search_rate);
+        fflush(stdout);
+        if (sum == 42) {
+            printf("\n");//防止求和被优化掉
+        }
+    }
+    return 0;
+}
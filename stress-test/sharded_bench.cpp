@@ -0,0 +1,45 @@
+/* ************************************************************************
+> File Name:     sharded_bench.cpp
+> Description:   固定线程数下，写吞吐随分片数的变化
+>                用法: ./bin/sharded_bench [线程数] [最大分片数] [总操作数] [key范围]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include "bench_util.h"
+#include "../sharded_skiplist.h"
+
+#define MAX_LEVEL 18
+
+int main(int argc, char **argv) {
+
+    int threads = static_cast<int>(bench::arg_or(argc, argv, 1, bench::hardware_threads()));
+    int max_shards = static_cast<int>(bench::arg_or(argc, argv, 2, 64));
+    long total_ops = bench::arg_or(argc, argv, 3, 1000000);
+    long key_range = bench::arg_or(argc, argv, 4, 100000);
+    long per_thread = total_ops / threads;
+
+    printf("threads: %d\n", threads);
+    printf("%-8s %16s\n", "shards", "ops/s");
+    std::vector<int> steps = bench::thread_steps(max_shards);
+    for (size_t s = 0; s < steps.size(); s++) {
+        ShardedSkipList<int, std::string> list(MAX_LEVEL, HashPartitioner<int>(steps[s]));
+        for (long i = 0; i < key_range; i += 2) {
+            list.insert_element(static_cast<int>(i), "a");
+        }
+        double elapsed = bench::run_threads(threads, [&](int tid) {
+            bench::Rng rng(tid + 1);
+            for (long i = 0; i < per_thread; i++) {
+                int key = static_cast<int>(rng.next(key_range));
+                if (rng.next() & 1) {
+                    list.insert_element(key, "a");
+                } else {
+                    list.delete_element(key);
+                }
+            }
+        });
+        printf("%-8d %16.0f\n", steps[s], per_thread * threads / elapsed);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+/* ************************************************************************
+> File Name:     snapshot_bench.cpp
+> Description:   文本dump_file/load_file与二进制快照的写出、加载耗时对比
+>                用法: ./bin/snapshot_bench [key数量] [value字节数] [临时目录]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <sys/stat.h>
+#include "bench_util.h"
+#include "../skiplist.h"
+
+#define MAX_LEVEL 26
+
+typedef SkipList<std::string, std::string> List;
+
+inline double file_mb(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? st.st_size / 1048576.0 : 0;
+}
+
+int main(int argc, char **argv) {
+
+    long count = bench::arg_or(argc, argv, 1, 1000000);
+    size_t value_size = static_cast<size_t>(bench::arg_or(argc, argv, 2, 100));
+    std::string dir = argc > 3 ? argv[3] : "/tmp";
+    std::string text_path = dir + "/skiplist_bench.txt";
+    std::string snap_path = dir + "/skiplist_bench.snap";
+
+    bench::QuietStdout quiet;//dump_file/load_file会打印
+    List list(MAX_LEVEL);
+    char key[32];
+    for (long i = 0; i < count; i++) {
+        snprintf(key, sizeof(key), "key%010ld", i);
+        list.insert_or_assign(std::string(key), std::string(value_size, 'v'));
+    }
+
+    double start = bench::now_seconds();
+    list.dump_file(text_path);
+    double text_dump = bench::now_seconds() - start;
+
+    start = bench::now_seconds();
+    bool dumped = list.dump_snapshot(snap_path);
+    double snap_dump = bench::now_seconds() - start;
+
+    double text_load, snap_load;
+    int text_size, snap_size;
+    bool loaded;
+    {
+        List loaded_list(MAX_LEVEL);
+        start = bench::now_seconds();
+        loaded_list.load_file(text_path);
+        text_load = bench::now_seconds() - start;
+        text_size = loaded_list.size();
+    }
+    {
+        List loaded_list(MAX_LEVEL);
+        start = bench::now_seconds();
+        loaded = loaded_list.load_snapshot(snap_path);
+        snap_load = bench::now_seconds() - start;
+        snap_size = loaded_list.size();
+    }
+
+    printf("keys: %ld, value: %zu bytes\n", count, value_size);
+    printf("%-10s %10s %10s %10s %10s\n", "format", "file(MB)", "dump(s)", "load(s)", "loaded");
+    printf("%-10s %10.1f %10.3f %10.3f %10d\n", "text", file_mb(text_path), text_dump, text_load, text_size);
+    printf("%-10s %10.1f %10.3f %10.3f %10d%s\n", "snapshot", file_mb(snap_path), snap_dump, snap_load, snap_size,
+           dumped && loaded ? "" : " (failed)");
+
+    unlink(text_path.c_str());
+    unlink(snap_path.c_str());
+    return 0;
+}
@@ -0,0 +1,82 @@
+/* ************************************************************************
+> File Name:     splice_bench.cpp
+> Description:   分片迁移: 把一段key从一个跳表移到另一个跳表，
+>                逐个delete_element + insert_element 对比 split_at + merge；
+>                以及删除一段key，逐个delete_element对比erase_range
+>                用法: ./bin/splice_bench [key数量] [迁移的百分比]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <vector>
+#include "bench_util.h"
+#include "../skiplist.h"
+
+#define MAX_LEVEL 18
+
+typedef SkipList<int, int> List;
+
+static void fill(List &list, long count) {
+    std::vector<std::pair<int, int> > items;
+    for (long i = 0; i < count; i++) {
+        items.push_back(std::make_pair(static_cast<int>(i), static_cast<int>(i)));
+    }
+    list.bulk_load(items.begin(), items.end());
+}
+
+int main(int argc, char **argv) {
+
+    long count = bench::arg_or(argc, argv, 1, 1000000);
+    long pct = bench::arg_or(argc, argv, 2, 25);
+    int cut = static_cast<int>(count - count * pct / 100);//迁移[cut, count)
+    long moved = count - cut;
+    printf("keys: %ld, moving the top %ld%% (%ld keys) to another list\n", count, pct, moved);
+    printf("%-28s %14s %12s\n", "method", "total(ms)", "ns/key");
+
+    {
+        List from(MAX_LEVEL), to(MAX_LEVEL);
+        fill(from, count);
+        double start = bench::now_seconds();
+        for (int k = cut; k < count; k++) {
+            std::optional<int> v = from.find(k);
+            from.delete_element(k);
+            to.insert_element(k, *v);
+        }
+        double ms = (bench::now_seconds() - start) * 1e3;
+        printf("%-28s %14.2f %12.1f\n", "per-key delete + insert", ms, ms * 1e6 / moved);
+    }
+    {
+        List from(MAX_LEVEL), to(MAX_LEVEL), target(MAX_LEVEL);
+        fill(from, count);
+        double start = bench::now_seconds();
+        from.split_at(cut, to);
+        double split_ms = (bench::now_seconds() - start) * 1e3;
+        start = bench::now_seconds();
+        target.merge(to);
+        double merge_ms = (bench::now_seconds() - start) * 1e3;
+        printf("%-28s %14.3f %12.1f\n", "split_at", split_ms, split_ms * 1e6 / moved);
+        printf("%-28s %14.3f %12.1f%s\n", "merge (into empty list)", merge_ms, merge_ms * 1e6 / moved,
+               from.size() == static_cast<size_t>(cut) && target.size() == static_cast<size_t>(moved) ? "" :
+               " (wrong sizes)");
+    }
+    {
+        List from(MAX_LEVEL);
+        fill(from, count);
+        double start = bench::now_seconds();
+        for (int k = cut; k < count; k++) {
+            from.delete_element(k);
+        }
+        double ms = (bench::now_seconds() - start) * 1e3;
+        printf("%-28s %14.2f %12.1f\n", "per-key delete", ms, ms * 1e6 / moved);
+    }
+    {
+        List from(MAX_LEVEL);
+        fill(from, count);
+        double start = bench::now_seconds();
+        size_t erased = from.erase_range(cut, static_cast<int>(count));
+        double ms = (bench::now_seconds() - start) * 1e3;
+        printf("%-28s %14.2f %12.1f%s\n", "erase_range", ms, ms * 1e6 / moved,
+               erased == static_cast<size_t>(moved) ? "" : " (wrong count)");
+    }
+    return 0;
+}
@@ -71,6 +71,9 @@ int main() {
         auto finish = std::chrono::high_resolution_clock::now(); 
         std::chrono::duration<double> elapsed = finish - start;
         std::cout << "insert elapsed:" << elapsed.count() << std::endl;
+#ifdef SKIPLIST_STATS
+        std::cout << skipList.stats().to_string();
+#endif
     }
     // skipList.displayList();
 
@@ -0,0 +1,107 @@
+/* ************************************************************************
+> File Name:     ttl_bench.cpp
+> Description:   带过期和淘汰的跳表: 内存上限下zipfian读的命中率(LRU对比按写入顺序淘汰)，
+>                以及写入的耗时(普通跳表、不设TTL、设TTL)
+>                用法: ./bin/ttl_bench [key数量] [内存上限占全部数据的百分比]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "../skiplist.h"
+#include "../ttl_skiplist.h"
+
+#define MAX_LEVEL 18
+#define VALUE_SIZE 100
+#define READ_COUNT 2000000
+
+// 缓存用法: 读不到时写入，统计命中率
+static void run_cache(const char *name, EvictionPolicy policy, long count, size_t budget) {
+    TtlSkipList<long, std::string> cache(MAX_LEVEL, budget, policy);
+    std::string value(VALUE_SIZE, 'v');
+    bench::Zipfian zipf(count, 0.99);
+    bench::Rng rng(11);
+    long hits = 0;
+    double start = bench::now_seconds();
+    for (long i = 0; i < READ_COUNT; i++) {
+        long key = static_cast<long>(zipf.next(rng));
+        if (cache.search_element(key)) {
+            hits++;
+        } else {
+            cache.insert_element(key, value);
+        }
+    }
+    double ns = (bench::now_seconds() - start) * 1e9 / READ_COUNT;
+    TtlStats s = cache.stats();
+    printf("%-8s %10.1f%% %10zu %12llu %10.0f\n", name, 100.0 * hits / READ_COUNT, s.entries,
+           (unsigned long long)s.evicted, ns);
+    fflush(stdout);
+}
+
+// 写入count个key，每次的平均纳秒数
+template<typename Fn>
+static double insert_ns(long count, Fn fn) {
+    double start = bench::now_seconds();
+    for (long i = 0; i < count; i++) {
+        fn(i);
+    }
+    return (bench::now_seconds() - start) * 1e9 / count;
+}
+
+int main(int argc, char **argv) {
+
+    long count = bench::arg_or(argc, argv, 1, 1000000);
+    long budget_pct = bench::arg_or(argc, argv, 2, 10);
+
+    std::vector<long> keys;
+    for (long i = 0; i < count; i++) {
+        keys.push_back(i);
+    }
+    bench::Rng rng(7);
+    for (long i = count - 1; i > 0; i--) {
+        std::swap(keys[i], keys[rng.next(i + 1)]);
+    }
+    std::string value(VALUE_SIZE, 'v');
+
+    // 先把全部key写入一次，得到全部数据的估算内存，按百分比设上限
+    size_t full;
+    {
+        TtlSkipList<long, std::string> all(MAX_LEVEL);
+        for (long i = 0; i < count; i++) {
+            all.insert_element(keys[i], value);
+        }
+        full = all.stats().memory_usage;
+    }
+    size_t budget = full * budget_pct / 100;
+    printf("keys: %ld, value size: %d, zipfian theta 0.99, budget: %zu bytes (%ld%% of %zu)\n", count, VALUE_SIZE,
+           budget, budget_pct, full);
+    printf("%-8s %11s %10s %12s %10s\n", "policy", "hit rate", "entries", "evicted", "ns/op");
+    run_cache("lru", EVICT_LRU, count, budget);
+    run_cache("oldest", EVICT_OLDEST, count, budget);
+
+    printf("\ninsert %ld keys (ns per insert)\n", count);
+    {
+        SkipList<long, std::string> list(MAX_LEVEL);
+        printf("%-24s %10.0f\n", "skiplist", insert_ns(count, [&](long i) { list.insert_element(keys[i], value); }));
+    }
+    {
+        TtlSkipList<long, std::string> list(MAX_LEVEL);
+        printf("%-24s %10.0f\n", "ttl list, no ttl",
+               insert_ns(count, [&](long i) { list.insert_element(keys[i], value); }));
+    }
+    {
+        TtlSkipList<long, std::string> list(MAX_LEVEL);
+        printf("%-24s %10.0f\n", "ttl list, ttl 60s",
+               insert_ns(count, [&](long i) { list.insert_element(keys[i], value, 60000); }));
+    }
+    {
+        // TTL很短，写入的同时不断有key过期，由写操作顺带清理
+        TtlSkipList<long, std::string> list(MAX_LEVEL);
+        printf("%-24s %10.0f",  "ttl list, ttl 1ms",
+               insert_ns(count, [&](long i) { list.insert_element(keys[i], value, 1); }));
+        printf("   (%zu left, %llu expired)\n", list.size(), (unsigned long long)list.stats().expired);
+    }
+    return 0;
+}
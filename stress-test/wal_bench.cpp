@@ -0,0 +1,193 @@
+/* ************************************************************************
+> File Name:     wal_bench.cpp
+> Description:   预写日志对写吞吐的影响: 纯内存 vs 各种落盘策略，线程数从1递增。
+>                之后检查恢复路径: 重放日志、截断写了一半的尾部记录、checkpoint后从快照加日志恢复、
+>                写盘失败(/dev/full)时wal_failed()报告失败；结果与std::map对照，不一致时返回1
+>                用法: ./bin/wal_bench [最大线程数] [每个线程的写次数] [日志目录]
+ ************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <map>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bench_util.h"
+#include "../skiplist.h"
+
+#define MAX_LEVEL 18
+#define KEY_RANGE 1000000
+
+typedef SkipList<int, std::string> List;
+
+// mode < 0 表示不打开日志
+double run(int threads, long ops, int mode, const std::string &path) {
+    unlink(path.c_str());
+    List list(MAX_LEVEL);
+    if (mode >= 0 && !list.open_wal(path, static_cast<WalSyncPolicy>(mode))) {
+        printf("open %s failed\n", path.c_str());
+        return 0;
+    }
+    double elapsed = bench::run_threads(threads, [&list, ops](int tid) {
+        bench::Rng rng(tid + 1);
+        std::string value(64, 'v');
+        for (long i = 0; i < ops; i++) {
+            list.insert_or_assign(static_cast<int>(rng.next(KEY_RANGE)), value);
+        }
+    });
+    list.close_wal();
+    unlink(path.c_str());
+    return threads * ops / elapsed;
+}
+
+static long file_size(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? static_cast<long>(st.st_size) : -1;
+}
+
+// 把跳表写成快照再读回来，与expect逐条比较；check是临时文件
+static bool same(List &list, const std::map<int, std::string> &expect, const std::string &check) {
+    std::map<int, std::string> actual;
+    SnapshotBlockStatus status = SNAPSHOT_BLOCK_ERROR;
+    SnapshotReader<int, std::string> reader;
+    if (list.dump_snapshot(check) && reader.open(check) && reader.verify()) {
+        while ((status = reader.read_block([&actual](const int &key, const std::string_view &value) {
+                    actual[key] = std::string(value);
+                })) == SNAPSHOT_BLOCK_OK) {
+        }
+    }
+    unlink(check.c_str());
+    return status == SNAPSHOT_BLOCK_END && actual == expect;
+}
+
+// 检查恢复路径，全部通过返回true
+static bool check_recovery(long ops, const std::string &dir) {
+    std::string wal = dir + "/skiplist_recover.wal";
+    std::string snap = dir + "/skiplist_recover.snapshot";
+    std::string check = dir + "/skiplist_recover.check";
+    unlink(wal.c_str());
+    unlink(snap.c_str());
+    std::map<int, std::string> expect;
+    bench::Rng rng(5);
+    {
+        List list(MAX_LEVEL);
+        if (!list.recover(snap, wal, WAL_SYNC_NONE)) {
+            printf("recovery: recover from nothing failed\n");
+            return false;
+        }
+        for (long i = 0; i < ops; i++) {
+            int key = static_cast<int>(rng.next(ops / 4 + 1));
+            if (rng.next(4) == 0) {
+                list.delete_element(key);
+                expect.erase(key);
+            } else {
+                std::string value = "v" + std::to_string(i);
+                list.insert_or_assign(key, value);
+                expect[key] = value;
+            }
+        }
+        list.close_wal();
+    }
+    long wal_size = file_size(wal);
+
+    // 1. 重放
+    double start = bench::now_seconds();
+    {
+        List list(MAX_LEVEL);
+        if (!list.recover(snap, wal) || !same(list, expect, check)) {
+            printf("recovery: replay mismatch\n");
+            return false;
+        }
+    }
+    printf("recovery: replayed %ld records in %.1f ms\n", ops, (bench::now_seconds() - start) * 1e3);
+
+    // 2. 尾部追加一条写了一半的记录(长度说有100字节，实际只有10字节)，恢复时应截掉
+    {
+        FILE *f = fopen(wal.c_str(), "ab");
+        uint32_t len = 100, crc = 0;
+        fwrite(&len, sizeof(len), 1, f);
+        fwrite(&crc, sizeof(crc), 1, f);
+        fwrite("0123456789", 1, 10, f);
+        fclose(f);
+    }
+    {
+        List list(MAX_LEVEL);
+        bool ok = list.recover(snap, wal) && same(list, expect, check) && file_size(wal) == wal_size;
+        list.insert_or_assign(-1, std::string("after torn tail"));//截断后追加的记录下次要能读到
+        expect[-1] = "after torn tail";
+        list.close_wal();
+        List again(MAX_LEVEL);
+        if (!ok || !again.recover(snap, wal) || !same(again, expect, check)) {
+            printf("recovery: torn tail not truncated\n");
+            return false;
+        }
+    }
+    printf("recovery: torn tail truncated\n");
+
+    // 3. checkpoint清空日志，之后的修改从快照加日志恢复
+    {
+        List list(MAX_LEVEL);
+        if (!list.recover(snap, wal) || !list.checkpoint(snap) || file_size(wal) != 0) {
+            printf("recovery: checkpoint failed\n");
+            return false;
+        }
+        list.insert_or_assign(-2, std::string("after checkpoint"));
+        expect[-2] = "after checkpoint";
+        list.delete_element(-1);
+        expect.erase(-1);
+    }
+    {
+        List list(MAX_LEVEL);
+        if (!list.recover(snap, wal) || !same(list, expect, check)) {
+            printf("recovery: snapshot + wal mismatch after checkpoint\n");
+            return false;
+        }
+    }
+    printf("recovery: checkpoint + replay ok\n");
+
+    // 4. 写盘失败要报告出来，之后的写也不会被当作已持久
+    {
+        List list(MAX_LEVEL);
+        if (list.open_wal("/dev/full", WAL_SYNC_COMMIT)) {
+            list.insert_element(1, std::string("lost"));
+            bool failed_first = list.wal_failed();
+            list.insert_element(2, std::string("lost"));
+            if (!failed_first || !list.wal_failed() || list.sync_wal()) {
+                printf("recovery: write failure not reported\n");
+                return false;
+            }
+            printf("recovery: write failure reported\n");
+        }
+    }
+    unlink(wal.c_str());
+    unlink(snap.c_str());
+    return true;
+}
+
+int main(int argc, char **argv) {
+
+    int max_threads = static_cast<int>(bench::arg_or(argc, argv, 1, bench::hardware_threads()));
+    long ops = bench::arg_or(argc, argv, 2, 20000);
+    std::string dir = argc > 3 ? argv[3] : "/tmp";
+    std::string path = dir + "/skiplist_bench.wal";
+
+    const char *names[] = {"memory", "wal none", "wal interval", "wal commit"};
+    const int modes[] = {-1, WAL_SYNC_NONE, WAL_SYNC_INTERVAL, WAL_SYNC_COMMIT};
+
+    printf("ops per thread: %ld, value: 64 bytes\n", ops);
+    printf("%-8s %-14s %14s %10s\n", "threads", "mode", "ops/s", "vs memory");
+    std::vector<int> steps = bench::thread_steps(max_threads);
+    for (size_t s = 0; s < steps.size(); s++) {
+        double base = 0;
+        for (int m = 0; m < 4; m++) {
+            double rate = run(steps[s], ops, modes[m], path);
+            if (m == 0) {
+                base = rate;
+            }
+            printf("%-8d %-14s %14.0f %9.2fx\n", steps[s], names[m], rate, base / rate);
+            fflush(stdout);
+        }
+    }
+    printf("\n");
+    return check_recovery(ops, dir) ? 0 : 1;
+}
@@ -5,5 +5,5 @@
 # Created Time: Wed Jan 30 20:05:15 2019
 #########################################################################
 #!/bin/bash
-g++ stress-test/stress_test.cpp -o ./bin/stress  --std=c++11 -pthread 
+g++ stress-test/stress_test.cpp -o ./bin/stress  -O2 --std=c++17 -pthread 
 ./bin/stress
@@ -0,0 +1,450 @@
+/* ************************************************************************
+> File Name:     ttl_skiplist.h
+> Description:   带过期时间和内存上限的跳表，用作有序缓存
+>                过期: 每个key可以设TTL，写操作顺带清理少量已过期的key，也可以开后台线程分批清理，
+>                      任何时候都不会一次扫描整个表
+>                淘汰: 估算的内存超过上限时按策略淘汰，EVICT_OLDEST淘汰最早写入的key，
+>                      EVICT_LRU用CLOCK(二次机会)近似LRU
+ ************************************************************************/
+
+#ifndef TTL_SKIPLIST_H
+#define TTL_SKIPLIST_H
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include "skiplist.h"
+
+#define TTL_WRITE_SWEEP 2       // 每次写操作顺带清理的过期key数
+#define TTL_SWEEP_BATCH 128     // 后台清理每次加锁处理的过期key数
+#define TTL_QUEUE_SWEEP 4       // 淘汰队列压缩期间每次写操作检查的记录数，要大于每次写入队的1条
+
+enum EvictionPolicy {
+    EVICT_OLDEST,   // 最早写入(或最后一次写入最早)的key先淘汰
+    EVICT_LRU,      // 近似LRU: 队头的key如果写入后被读过，给一次机会移到队尾
+};
+
+// 跳表中实际存放的value
+template<typename V>
+struct TtlEntry {
+    TtlEntry() : expire_at(0), seq(0), referenced(false) {}
+    TtlEntry(const V &v, uint64_t expire, uint64_t s) : value(v), expire_at(expire), seq(s), referenced(false) {}
+
+    V value;
+    uint64_t expire_at;//过期时刻(毫秒，steady_clock)，0为不过期
+    uint64_t seq;//写入序号，与淘汰队列中的记录对应
+    mutable bool referenced;//写入或上次被跳过之后是否被读过，读操作在锁内直接修改
+};
+
+// 过期与淘汰的计数
+struct TtlStats {
+    TtlStats() : entries(0), memory_usage(0), memory_budget(0), expired(0), evicted(0) {}
+
+    size_t entries;
+    size_t memory_usage;
+    size_t memory_budget;
+    uint64_t expired;//因过期删除的key数
+    uint64_t evicted;//因超出内存上限淘汰的key数
+};
+
+// 带过期和淘汰的跳表
+// 数据存在SkipList<K, TtlEntry<V>>中；设了TTL的key另外按(过期时刻, key)存在一个跳表里作为过期索引，
+// 清理时从它的开头取；淘汰队列按写入顺序记录(key, 序号)，key被覆盖或删除后队列中的旧记录在出队时跳过。
+// 旧记录太多时开始压缩队列，每次写操作只检查TTL_QUEUE_SWEEP条，保持顺序把有效记录前移，扫完再截断。
+// 所有操作在本类的锁内完成，内部两个跳表的锁不会竞争。
+template <typename K, typename V, typename Compare = std::less<K> >
+class TtlSkipList {
+
+public:
+    // memory_budget为0时不限制内存
+    TtlSkipList(int max_level, size_t memory_budget = 0, EvictionPolicy policy = EVICT_LRU,
+                const Compare& compare = Compare());
+    ~TtlSkipList();
+
+    // ttl_ms为0时不过期；返回值同SkipList::insert_element
+    int insert_element(const K&, const V&, uint64_t ttl_ms = 0);
+    // 已过期的key视为不存在，并顺带删除
+    bool search_element(const K&, V* value = NULL);
+    bool delete_element(const K&);
+    size_t size();
+
+    // 清理最多max_entries个已过期的key，返回清理的个数
+    size_t expire(size_t max_entries = TTL_SWEEP_BATCH);
+    // 后台清理: 每interval_ms毫秒分批清理一次，两批之间释放锁
+    void start_sweeper(int interval_ms = 100);
+    void stop_sweeper();
+
+    void set_memory_budget(size_t bytes);
+    TtlStats stats();
+
+    static uint64_t now_ms();
+
+private:
+    typedef TtlEntry<V> Entry;
+    typedef std::pair<uint64_t, K> ExpireKey;
+    typedef std::pair<K, uint64_t> QueueItem;
+
+    // 过期索引的顺序: 先比过期时刻，相同时用跳表的Compare比key
+    struct ExpireCompare {
+        ExpireCompare(const Compare& c) : compare(c) {}
+        bool operator()(const ExpireKey& a, const ExpireKey& b) const {
+            if (a.first != b.first) {
+                return a.first < b.first;
+            }
+            return compare(a.second, b.second);
+        }
+        Compare compare;
+    };
+
+    TtlSkipList(const TtlSkipList &);
+    TtlSkipList &operator=(const TtlSkipList &);
+
+    // 以下都在锁内调用
+    // stored_key不为NULL时返回跳表节点中的key
+    bool find_entry(const K& key, const Entry** entry, const K** stored_key = NULL);
+    // key和entry必须是跳表节点中存放的对象，内存估算与插入时一致
+    void erase_entry(const K& key, const Entry& entry);
+    size_t expire_locked(size_t max_entries, uint64_t now);
+    bool evict_one();
+    bool queue_live(const QueueItem& item);
+    void compact_queue(size_t max_items);
+    bool skip_queue_gap();
+    void pop_queue();
+    size_t entry_bytes(const K& key, const Entry& entry) const;
+    // key在跳表节点中的存放，按它估算内存，与调用者传入的key的容量无关
+    size_t stored_bytes(const K& key);
+
+    void sweeper_loop(int interval_ms);
+
+private:
+    SkipList<K, Entry, Compare> _list;
+
+    // 过期索引，按(过期时刻, key)排序
+    SkipList<ExpireKey, char, ExpireCompare> _expire_index;
+
+    // 淘汰队列: (key, 写入序号)
+    std::deque<QueueItem> _queue;
+    // 压缩进行中时，[0, _compact_write)是已检查的有效记录，[_compact_write, _compact_read)是空位，
+    // [_compact_read, 队尾)还没检查
+    bool _compacting;
+    size_t _compact_read;
+    size_t _compact_write;
+
+    Compare _compare;
+    EvictionPolicy _policy;
+    size_t _memory_budget;
+    size_t _memory_usage;
+    uint64_t _next_seq;
+    uint64_t _expired;
+    uint64_t _evicted;
+
+    std::mutex _mtx;
+
+    std::thread _sweeper;
+    bool _sweeper_stop;
+    std::condition_variable _sweeper_cv;
+};
+
+template<typename K, typename V, typename Compare>
+TtlSkipList<K, V, Compare>::TtlSkipList(int max_level, size_t memory_budget, EvictionPolicy policy,
+                                        const Compare& compare)
+    : _list(max_level, compare), _expire_index(max_level, ExpireCompare(compare)), _compacting(false), _compact_read(0),
+      _compact_write(0), _compare(compare), _policy(policy),
+      _memory_budget(memory_budget), _memory_usage(0), _next_seq(0), _expired(0), _evicted(0), _sweeper_stop(false) {}
+
+template<typename K, typename V, typename Compare>
+TtlSkipList<K, V, Compare>::~TtlSkipList() {
+    stop_sweeper();
+}
+
+template<typename K, typename V, typename Compare>
+uint64_t TtlSkipList<K, V, Compare>::now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 估算一个key占用的内存: 节点 + key/value的堆内存，以及过期索引中的节点和淘汰队列中的记录。
+// 节点的forward数组按p=1/2的平均层数计，比第0层多一个指针
+template<typename K, typename V, typename Compare>
+size_t TtlSkipList<K, V, Compare>::entry_bytes(const K& key, const Entry& entry) const {
+    size_t extra_forward = sizeof(void*);
+    size_t bytes = Node<K, Entry>::block_size(0) + extra_forward + HeapBytes<K>::of(key) +
+                   HeapBytes<V>::of(entry.value) + sizeof(QueueItem) + HeapBytes<K>::of(key);
+    if (entry.expire_at != 0) {
+        bytes += Node<ExpireKey, char>::block_size(0) + extra_forward + HeapBytes<K>::of(key);
+    }
+    return bytes;
+}
+
+template<typename K, typename V, typename Compare>
+size_t TtlSkipList<K, V, Compare>::stored_bytes(const K& key) {
+    typename SkipList<K, Entry, Compare>::iterator it = _list.lower_bound(key);
+    return entry_bytes(it->get_key(), it->get_value());
+}
+
+// 找到key且没过期时返回true；已过期的直接删除
+template<typename K, typename V, typename Compare>
+bool TtlSkipList<K, V, Compare>::find_entry(const K& key, const Entry** entry, const K** stored_key) {
+    typename SkipList<K, Entry, Compare>::iterator it = _list.lower_bound(key);
+    if (it == _list.end() || _compare(key, it->get_key())) {
+        return false;
+    }
+    const Entry &e = it->get_value();
+    if (e.expire_at != 0 && e.expire_at <= now_ms()) {
+        erase_entry(it->get_key(), e);
+        _expired++;
+        return false;
+    }
+    *entry = &e;
+    if (stored_key != NULL) {
+        *stored_key = &it->get_key();
+    }
+    return true;
+}
+
+// 从数据和过期索引中删除，淘汰队列中的记录留到出队时跳过
+template<typename K, typename V, typename Compare>
+void TtlSkipList<K, V, Compare>::erase_entry(const K& key, const Entry& entry) {
+    _memory_usage -= entry_bytes(key, entry);
+    K k = key;//删除后key的引用失效
+    if (entry.expire_at != 0) {
+        _expire_index.delete_element(ExpireKey(entry.expire_at, k));
+    }
+    _list.delete_element(k);
+}
+
+template<typename K, typename V, typename Compare>
+int TtlSkipList<K, V, Compare>::insert_element(const K& key, const V& value, uint64_t ttl_ms) {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    uint64_t now = now_ms();
+    expire_locked(TTL_WRITE_SWEEP, now);
+
+    const Entry *old = NULL;
+    const K *stored = NULL;
+    int existed = find_entry(key, &old, &stored) ? 1 : 0;
+    if (existed) {
+        _memory_usage -= entry_bytes(*stored, *old);
+        if (old->expire_at != 0) {
+            _expire_index.delete_element(ExpireKey(old->expire_at, key));
+        }
+    }
+
+    Entry entry(value, ttl_ms == 0 ? 0 : now + ttl_ms, _next_seq++);
+    if (entry.expire_at != 0) {
+        _expire_index.insert_element(ExpireKey(entry.expire_at, key), 0);
+    }
+    _queue.push_back(QueueItem(key, entry.seq));//覆盖写也重新排到队尾
+    _list.insert_element(key, entry);
+    _memory_usage += stored_bytes(key);
+
+    while (_memory_budget != 0 && _memory_usage > _memory_budget && evict_one()) {
+    }
+    // 覆盖写和删除留下的旧记录超过元素数时开始压缩队列，分摊到之后的写操作
+    if (!_compacting && _queue.size() > 2 * _list.size() + 64) {
+        _compacting = true;
+        _compact_read = 0;
+        _compact_write = 0;
+    }
+    if (_compacting) {
+        compact_queue(TTL_QUEUE_SWEEP);
+    }
+    return existed;
+}
+
+// 队列中的记录是否还对应key当前的写入
+template<typename K, typename V, typename Compare>
+bool TtlSkipList<K, V, Compare>::queue_live(const QueueItem& item) {
+    const Entry *entry;
+    return find_entry(item.first, &entry) && entry->seq == item.second;
+}
+
+// 检查最多max_items条未检查的记录，有效的前移到已检查部分的末尾；全部检查完后截掉空位
+template<typename K, typename V, typename Compare>
+void TtlSkipList<K, V, Compare>::compact_queue(size_t max_items) {
+    for (size_t i = 0; i < max_items && _compact_read < _queue.size(); i++, _compact_read++) {
+        if (queue_live(_queue[_compact_read])) {
+            if (_compact_write != _compact_read) {
+                _queue[_compact_write] = std::move(_queue[_compact_read]);
+            }
+            _compact_write++;
+        }
+    }
+    if (_compact_read == _queue.size()) {
+        _queue.resize(_compact_write);
+        _compacting = false;
+    }
+}
+
+// 压缩进行中且已检查部分为空时，队头是空位，先去掉；返回队列是否非空
+template<typename K, typename V, typename Compare>
+bool TtlSkipList<K, V, Compare>::skip_queue_gap() {
+    if (_compacting && _compact_write == 0 && _compact_read > 0) {
+        _queue.erase(_queue.begin(), _queue.begin() + _compact_read);
+        _compact_read = 0;
+    }
+    return !_queue.empty();
+}
+
+// 弹出队头(先调用skip_queue_gap)，压缩进行中时维护两个位置
+template<typename K, typename V, typename Compare>
+void TtlSkipList<K, V, Compare>::pop_queue() {
+    _queue.pop_front();
+    if (_compacting) {
+        if (_compact_write > 0) {
+            _compact_write--;
+            _compact_read--;
+        }
+        if (_compact_read == _queue.size()) {
+            _queue.resize(_compact_write);
+            _compacting = false;
+        }
+    }
+}
+
+template<typename K, typename V, typename Compare>
+bool TtlSkipList<K, V, Compare>::search_element(const K& key, V* value) {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    const Entry *entry;
+    if (!find_entry(key, &entry)) {
+        return false;
+    }
+    entry->referenced = true;
+    if (value != NULL) {
+        *value = entry->value;
+    }
+    return true;
+}
+
+template<typename K, typename V, typename Compare>
+bool TtlSkipList<K, V, Compare>::delete_element(const K& key) {
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    const Entry *entry;
+    const K *stored;
+    if (!find_entry(key, &entry, &stored)) {
+        return false;
+    }
+    erase_entry(*stored, *entry);
+    return true;
+}
+
+template<typename K, typename V, typename Compare>
+size_t TtlSkipList<K, V, Compare>::size() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _list.size();
+}
+
+// 从过期索引开头取已到期的key，最多max_entries个
+template<typename K, typename V, typename Compare>
+size_t TtlSkipList<K, V, Compare>::expire_locked(size_t max_entries, uint64_t now) {
+
+    std::vector<K> keys;
+    for (typename SkipList<ExpireKey, char, ExpireCompare>::iterator it = _expire_index.begin();
+         it != _expire_index.end() && keys.size() < max_entries && it->get_key().first <= now; ++it) {
+        keys.push_back(it->get_key().second);
+    }
+    for (size_t i = 0; i < keys.size(); i++) {
+        typename SkipList<K, Entry, Compare>::iterator it = _list.lower_bound(keys[i]);
+        erase_entry(it->get_key(), it->get_value());
+    }
+    _expired += keys.size();
+    return keys.size();
+}
+
+template<typename K, typename V, typename Compare>
+size_t TtlSkipList<K, V, Compare>::expire(size_t max_entries) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return expire_locked(max_entries, now_ms());
+}
+
+// 淘汰一个key，没有可淘汰的返回false
+// 先清理已过期的；否则从队头取，跳过已被覆盖或删除的旧记录，LRU策略下读过的key清掉标记移到队尾
+template<typename K, typename V, typename Compare>
+bool TtlSkipList<K, V, Compare>::evict_one() {
+
+    if (expire_locked(1, now_ms()) > 0) {
+        return true;
+    }
+    while (skip_queue_gap()) {
+        QueueItem front = std::move(_queue.front());
+        pop_queue();
+        const Entry *entry;
+        const K *stored;
+        if (!find_entry(front.first, &entry, &stored) || entry->seq != front.second) {
+            continue;
+        }
+        if (_policy == EVICT_LRU && entry->referenced) {
+            entry->referenced = false;
+            _queue.push_back(front);
+            continue;
+        }
+        erase_entry(*stored, *entry);
+        _evicted++;
+        return true;
+    }
+    return false;
+}
+
+template<typename K, typename V, typename Compare>
+void TtlSkipList<K, V, Compare>::set_memory_budget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _memory_budget = bytes;
+    while (_memory_budget != 0 && _memory_usage > _memory_budget && evict_one()) {
+    }
+}
+
+template<typename K, typename V, typename Compare>
+TtlStats TtlSkipList<K, V, Compare>::stats() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    TtlStats s;
+    s.entries = _list.size();
+    s.memory_usage = _memory_usage;
+    s.memory_budget = _memory_budget;
+    s.expired = _expired;
+    s.evicted = _evicted;
+    return s;
+}
+
+template<typename K, typename V, typename Compare>
+void TtlSkipList<K, V, Compare>::start_sweeper(int interval_ms) {
+    stop_sweeper();
+    _sweeper_stop = false;
+    _sweeper = std::thread(&TtlSkipList<K, V, Compare>::sweeper_loop, this, interval_ms);
+}
+
+template<typename K, typename V, typename Compare>
+void TtlSkipList<K, V, Compare>::stop_sweeper() {
+    if (!_sweeper.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _sweeper_stop = true;
+    }
+    _sweeper_cv.notify_all();
+    _sweeper.join();
+}
+
+template<typename K, typename V, typename Compare>
+void TtlSkipList<K, V, Compare>::sweeper_loop(int interval_ms) {
+    std::unique_lock<std::mutex> lock(_mtx);
+    while (!_sweeper_stop) {
+        _sweeper_cv.wait_for(lock, std::chrono::milliseconds(interval_ms));
+        // 每批处理完释放一次锁，让读写插进来
+        while (!_sweeper_stop && expire_locked(TTL_SWEEP_BATCH, now_ms()) == TTL_SWEEP_BATCH) {
+            lock.unlock();
+            std::this_thread::yield();
+            lock.lock();
+        }
+    }
+}
+
+#endif
+// vim: et tw=100 ts=4 sw=4 cc=120
@@ -0,0 +1,398 @@
+/* ************************************************************************
+> File Name:     wal.h
+> Description:   跳表的预写日志(WAL)与组提交
+>                记录格式: 4字节payload长度 + 4字节payload的CRC32C + payload
+>                payload:  1字节操作类型 + key [+ value]，编码见serialize.h
+ ************************************************************************/
+
+#ifndef SKIPLIST_WAL_H
+#define SKIPLIST_WAL_H
+
+#include <string>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "serialize.h"
+
+#define WAL_FILE "store/wal"
+#define WAL_RECORD_HEADER_SIZE 8
+#define WAL_OP_PUT 1
+#define WAL_OP_DELETE 2
+
+// 日志落盘策略
+enum WalSyncPolicy {
+    WAL_SYNC_NONE,      // commit只保证写进内核，不主动fsync，进程崩溃不丢，机器掉电可能丢
+    WAL_SYNC_COMMIT,    // commit返回前fdatasync；并发的commit合并为一次fdatasync(组提交)
+    WAL_SYNC_INTERVAL   // commit立即返回，后台线程每隔interval_ms写盘并fdatasync一次
+};
+
+// 跳表看到的日志接口
+// 跳表在自己的锁内调用log_put/log_delete，保证日志顺序与内存中的修改顺序一致；
+// 释放锁之后再调用commit等待落盘，这样等待fsync时不会挡住其他线程，多个线程的记录才能合并提交。
+// 写盘失败一次之后日志不再接受记录(log_*返回0)，之后的commit都返回false。
+// 用接口隔开是为了不给跳表的K、V加上可序列化的要求，只有真正打开日志时才需要Codec<K>、Codec<V>。
+template<typename K, typename V>
+class MutationLog {
+public:
+    virtual ~MutationLog() {}
+    // 追加一条记录，返回它的序号(从1开始递增)
+    virtual uint64_t log_put(const K& key, const V& value) = 0;
+    virtual uint64_t log_delete(const K& key) = 0;
+    // 等待序号不大于lsn的记录按策略落盘，写盘失败返回false
+    virtual bool commit(uint64_t lsn) = 0;
+    // 不论策略如何，把已追加的记录全部写盘并fdatasync
+    virtual bool sync() = 0;
+    // 丢弃已有的全部记录，调用者保证这些记录已经包含在一份快照中
+    virtual bool reset() = 0;
+    // 是否写盘失败过
+    virtual bool failed() = 0;
+};
+
+// 一次修改要提交的日志: 在锁内记下日志和序号，释放锁之后调用wait()等待落盘。
+// 持有日志的一份引用: 等待落盘时跳表可能已经关闭或换掉了日志，日志要等最后一个提交完成才释放
+template<typename K, typename V>
+struct WalCommit {
+    WalCommit() : lsn(0) {}
+    // 没有记日志时直接返回true，写盘失败返回false
+    bool wait() {
+        return log == NULL || log->commit(lsn);
+    }
+    std::shared_ptr<MutationLog<K, V> > log;
+    uint64_t lsn;
+};
+
+template<typename K, typename V>
+class WriteAheadLog : public MutationLog<K, V> {
+
+public:
+    WriteAheadLog();
+    ~WriteAheadLog();
+
+    // 以追加方式打开日志文件，不存在则创建
+    bool open(const std::string& path, WalSyncPolicy policy = WAL_SYNC_COMMIT, int interval_ms = 10);
+    // 把所有记录写盘并fdatasync，然后关闭文件
+    bool close();
+
+    uint64_t log_put(const K& key, const V& value);
+    uint64_t log_delete(const K& key);
+    bool commit(uint64_t lsn);
+    bool sync();
+    bool reset();
+    bool failed();
+
+    // 实际执行的写盘次数，记录数/写盘次数即组提交的合并程度
+    uint64_t flush_count();
+
+    // 按顺序重放日志中的记录: put调用fn(WAL_OP_PUT, key, &value)，delete调用fn(WAL_OP_DELETE, key, NULL)。
+    // 遇到不完整或CRC不对的记录(写到一半时崩溃)就停止，并把文件截断到最后一条完整记录。
+    // 文件不存在视为空日志；返回重放的记录数，打开失败返回-1
+    template<typename Fn>
+    static long replay(const std::string& path, Fn fn);
+
+private:
+    WriteAheadLog(const WriteAheadLog &);
+    WriteAheadLog &operator=(const WriteAheadLog &);
+
+    // 在_buffer末尾开始一条记录，返回记录头的位置
+    size_t begin_record(uint8_t op);
+    // 回填记录头，返回序号
+    uint64_t end_record(size_t start);
+
+    // 在持有_mtx时调用，直到序号不大于lsn的记录都已写盘，force为true时还要fdatasync
+    bool flush_until(std::unique_lock<std::mutex>& lock, uint64_t lsn, bool force);
+
+    void background_sync();
+
+private:
+    int _fd;
+    WalSyncPolicy _policy;
+    int _interval_ms;
+
+    std::mutex _mtx;
+    std::condition_variable _cv;
+
+    // 已追加但还没写盘的记录
+    std::string _buffer;
+    // 正在写盘的记录，只有当前写盘的线程(leader)会访问，与_buffer交换后复用内存
+    std::string _flushing_buffer;
+    bool _flushing;
+    bool _failed;
+
+    uint64_t _last_lsn;//最后追加的记录序号
+    uint64_t _written_lsn;//已写进内核的记录序号
+    uint64_t _synced_lsn;//已fdatasync的记录序号
+    uint64_t _flush_count;
+
+    bool _stop;
+    std::thread _sync_thread;
+};
+
+template<typename K, typename V>
+WriteAheadLog<K, V>::WriteAheadLog()
+    : _fd(-1), _policy(WAL_SYNC_COMMIT), _interval_ms(10), _flushing(false), _failed(false),
+      _last_lsn(0), _written_lsn(0), _synced_lsn(0), _flush_count(0), _stop(false) {}
+
+template<typename K, typename V>
+WriteAheadLog<K, V>::~WriteAheadLog() {
+    close();
+}
+
+template<typename K, typename V>
+bool WriteAheadLog<K, V>::open(const std::string& path, WalSyncPolicy policy, int interval_ms) {
+    _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (_fd < 0) {
+        return false;
+    }
+    _policy = policy;
+    _interval_ms = interval_ms > 0 ? interval_ms : 1;
+    _stop = false;
+    _failed = false;
+    if (_policy == WAL_SYNC_INTERVAL) {
+        _sync_thread = std::thread(&WriteAheadLog<K, V>::background_sync, this);
+    }
+    return true;
+}
+
+template<typename K, typename V>
+bool WriteAheadLog<K, V>::close() {
+    if (_sync_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            _stop = true;
+        }
+        _cv.notify_all();
+        _sync_thread.join();
+    }
+    if (_fd < 0) {
+        return true;
+    }
+    bool ok = sync();
+    ::close(_fd);
+    _fd = -1;
+    return ok;
+}
+
+template<typename K, typename V>
+size_t WriteAheadLog<K, V>::begin_record(uint8_t op) {
+    size_t start = _buffer.size();
+    _buffer.append(WAL_RECORD_HEADER_SIZE, '\0');
+    put_fixed<uint8_t>(_buffer, op);
+    return start;
+}
+
+template<typename K, typename V>
+uint64_t WriteAheadLog<K, V>::end_record(size_t start) {
+    const char *payload = _buffer.data() + start + WAL_RECORD_HEADER_SIZE;
+    uint32_t len = static_cast<uint32_t>(_buffer.size() - start - WAL_RECORD_HEADER_SIZE);
+    uint32_t crc = crc32c(payload, len);
+    memcpy(&_buffer[start], &len, sizeof(len));
+    memcpy(&_buffer[start + sizeof(len)], &crc, sizeof(crc));
+    return ++_last_lsn;
+}
+
+// 记录直接编码进待写缓冲，不经过临时对象
+// 写盘失败后缓冲不会再被写出，不再追加，返回0
+template<typename K, typename V>
+uint64_t WriteAheadLog<K, V>::log_put(const K& key, const V& value) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_failed) {
+        return 0;
+    }
+    size_t start = begin_record(WAL_OP_PUT);
+    Codec<K>::encode(_buffer, key);
+    Codec<V>::encode(_buffer, value);
+    return end_record(start);
+}
+
+template<typename K, typename V>
+uint64_t WriteAheadLog<K, V>::log_delete(const K& key) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_failed) {
+        return 0;
+    }
+    size_t start = begin_record(WAL_OP_DELETE);
+    Codec<K>::encode(_buffer, key);
+    return end_record(start);
+}
+
+// 组提交
+// 同一时刻只有一个线程(leader)在写盘。leader把当前缓冲中的所有记录一次写出并fdatasync，
+// 期间新到的记录继续在_buffer中攒着，由下一个leader一起写出；其他线程只需等待自己的序号完成。
+template<typename K, typename V>
+bool WriteAheadLog<K, V>::flush_until(std::unique_lock<std::mutex>& lock, uint64_t lsn, bool force) {
+    while (true) {
+        if (_failed) {
+            return false;
+        }
+        if (force ? _synced_lsn >= lsn : _written_lsn >= lsn) {
+            return true;
+        }
+        if (_flushing) {
+            _cv.wait(lock);
+            continue;
+        }
+
+        _flushing = true;
+        _flushing_buffer.swap(_buffer);
+        uint64_t upto = _last_lsn;
+        lock.unlock();
+
+        bool ok = true;
+        if (!_flushing_buffer.empty()) {
+            struct iovec iov = {const_cast<char*>(_flushing_buffer.data()), _flushing_buffer.size()};
+            ok = write_fully(_fd, &iov, 1);
+        }
+        if (ok && force) {
+            ok = fdatasync(_fd) == 0;
+        }
+        _flushing_buffer.clear();
+
+        lock.lock();
+        _flushing = false;
+        _flush_count++;
+        if (!ok) {
+            _failed = true;//写盘失败后不再接受提交，避免日志中出现空洞
+        } else {
+            _written_lsn = upto;
+            if (force) {
+                _synced_lsn = upto;
+            }
+        }
+        _cv.notify_all();
+    }
+}
+
+template<typename K, typename V>
+bool WriteAheadLog<K, V>::commit(uint64_t lsn) {
+    std::unique_lock<std::mutex> lock(_mtx);
+    if (_policy == WAL_SYNC_INTERVAL) {
+        return !_failed;//后台线程写盘失败后，之后的提交都报告失败
+    }
+    return flush_until(lock, lsn, _policy == WAL_SYNC_COMMIT);
+}
+
+template<typename K, typename V>
+bool WriteAheadLog<K, V>::sync() {
+    std::unique_lock<std::mutex> lock(_mtx);
+    return _fd < 0 || flush_until(lock, _last_lsn, true);
+}
+
+// 截断日志
+// 必须等正在进行的写盘结束，否则它写出的旧记录会落在截断之后，重放时覆盖快照中更新的数据
+template<typename K, typename V>
+bool WriteAheadLog<K, V>::reset() {
+    std::unique_lock<std::mutex> lock(_mtx);
+    while (_flushing) {
+        _cv.wait(lock);
+    }
+    if (_failed) {
+        return false;
+    }
+    _buffer.clear();
+    bool ok = ftruncate(_fd, 0) == 0 && fdatasync(_fd) == 0;
+    if (ok) {
+        _written_lsn = _synced_lsn = _last_lsn;
+    } else {
+        _failed = true;
+    }
+    _cv.notify_all();
+    return ok;
+}
+
+template<typename K, typename V>
+bool WriteAheadLog<K, V>::failed() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _failed;
+}
+
+template<typename K, typename V>
+uint64_t WriteAheadLog<K, V>::flush_count() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _flush_count;
+}
+
+template<typename K, typename V>
+void WriteAheadLog<K, V>::background_sync() {
+    std::unique_lock<std::mutex> lock(_mtx);
+    while (!_stop) {
+        _cv.wait_for(lock, std::chrono::milliseconds(_interval_ms));
+        if (_last_lsn > _synced_lsn && !flush_until(lock, _last_lsn, true)) {
+            return;
+        }
+    }
+}
+
+template<typename K, typename V>
+template<typename Fn>
+long WriteAheadLog<K, V>::replay(const std::string& path, Fn fn) {
+    int fd = ::open(path.c_str(), O_RDWR);
+    if (fd < 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    std::string data(st.st_size, '\0');
+    size_t got = 0;
+    while (got < data.size()) {
+        ssize_t n = pread(fd, &data[got], data.size() - got, got);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        got += n;
+    }
+    data.resize(got);
+
+    long count = 0;
+    size_t pos = 0;
+    K key;
+    V value;
+    while (data.size() - pos >= WAL_RECORD_HEADER_SIZE) {
+        const char *p = data.data() + pos;
+        const char *end = data.data() + data.size();
+        uint32_t len, crc;
+        if (!get_fixed(p, end, len) || !get_fixed(p, end, crc)) {
+            break;
+        }
+        if (static_cast<size_t>(end - p) < len || crc32c(p, len) != crc) {
+            break;
+        }
+        end = p + len;
+        uint8_t op;
+        if (!get_fixed(p, end, op) || !Codec<K>::decode(p, end, key)) {
+            break;
+        }
+        if (op == WAL_OP_PUT) {
+            if (!Codec<V>::decode(p, end, value)) {
+                break;
+            }
+            fn(op, key, &value);
+        } else if (op == WAL_OP_DELETE) {
+            fn(op, key, static_cast<V*>(NULL));
+        } else {
+            break;
+        }
+        pos += WAL_RECORD_HEADER_SIZE + len;
+        count++;
+    }
+
+    // 丢掉尾部不完整的记录，之后追加的记录才能被下次重放读到
+    if (pos < static_cast<size_t>(st.st_size) && ftruncate(fd, pos) != 0) {
+        count = -1;
+    }
+    ::close(fd);
+    return count;
+}
+
+#endif